@@ -5,7 +5,7 @@ die() {
   exit 1
 }
 
-VERSION=1.0.2
+VERSION=1.1.0
 BASE=corona-$VERSION-doxygen
 
 rm -rf html $BASE $BASE.tar $BASE.tar.gz $BASE.zip \
@@ -7,7 +7,7 @@ die() {
 }
 
 
-BASE=corona-1.0.2
+BASE=corona-1.1.0
 
 
 export CVSROOT=`cat CVS/Root`
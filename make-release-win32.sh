@@ -33,7 +33,7 @@ echo "Build complete.  Packaging..."
 echo
 
 DIST=dist
-NAME=corona-1.0.2-vc6
+NAME=corona-1.1.0-vc6
 
 scons -f vc6/dist.py prefix=$DIST/$NAME || die
 find . -name .sconsign | xargs rm -f
@@ -42,7 +42,7 @@ rm -f $DIST/$NAME.zip
 (cd $DIST && zip -r $NAME.zip $NAME) || die
 
 
-NAME=corona-1.0.2-vc7
+NAME=corona-1.1.0-vc7
 
 scons -f vc7/dist.py prefix=$DIST/$NAME || die
 find . -name .sconsign | xargs rm -f
@@ -1,3 +1,10 @@
 #!/bin/sh
 
-scons $* test && (cd test && ./CoronaTest)
+scons $* test && (cd test && ./CoronaTest) && (
+  cd test/bundled &&
+  ./ZlibTest &&
+  # the bundled libpng must decode the same with and without SSE
+  ./PNGUnfilterTest ../images/pngsuite/*.png > sse.txt &&
+  ./PNGUnfilterTest-scalar ../images/pngsuite/*.png > scalar.txt &&
+  cmp sse.txt scalar.txt
+)
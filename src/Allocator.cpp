@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include "Allocator.h"
+#include "Utility.h"
+
+
+namespace corona {
+
+  /**
+   * The default allocator: malloc with enough slack to align the
+   * buffer.  The start of the malloc'd block is kept just in front of
+   * the buffer so DefaultFree can find it.
+   */
+  void* COR_CALL DefaultAllocate(int size, int alignment, void* /*user_data*/) {
+    byte* block = (byte*)malloc(size_t(size) + alignment + sizeof(void*));
+    if (!block) {
+      return 0;
+    }
+
+    const size_t start = size_t(block + sizeof(void*));
+    byte* buffer = (byte*)((start + alignment - 1) & ~size_t(alignment - 1));
+    ((void**)buffer)[-1] = block;
+    return buffer;
+  }
+
+
+  void COR_CALL DefaultFree(
+    void* buffer,
+    int /*size*/,
+    int /*alignment*/,
+    void* /*user_data*/)
+  {
+    if (buffer) {
+      free(((void**)buffer)[-1]);
+    }
+  }
+
+
+  static BufferAllocator g_allocate  = DefaultAllocate;
+  static BufferDeleter   g_free      = DefaultFree;
+  static void*           g_user_data = 0;
+
+
+  byte* AllocateBuffer(int size) {
+    if (size < 0) {
+      return 0;
+    }
+    return (byte*)g_allocate(size, BUFFER_ALIGNMENT, g_user_data);
+  }
+
+
+  void FreeBuffer(void* buffer, int size) {
+    if (buffer) {
+      g_free(buffer, size, BUFFER_ALIGNMENT, g_user_data);
+    }
+  }
+
+
+  BufferDeleter GetBufferDeleter(void** user_data) {
+    *user_data = g_user_data;
+    return g_free;
+  }
+
+
+  namespace hidden {
+
+    COR_EXPORT(void) CorSetAllocator(
+      BufferAllocator allocate,
+      BufferDeleter free,
+      void* user_data)
+    {
+      if (allocate && free) {
+        g_allocate  = allocate;
+        g_free      = free;
+        g_user_data = user_data;
+      } else {
+        g_allocate  = DefaultAllocate;
+        g_free      = DefaultFree;
+        g_user_data = 0;
+      }
+    }
+
+  }
+
+}
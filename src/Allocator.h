@@ -0,0 +1,97 @@
+#ifndef CORONA_ALLOCATOR_H
+#define CORONA_ALLOCATOR_H
+
+
+#include "corona.h"
+#include "Types.h"
+
+
+namespace corona {
+
+  /// Every pixel and palette buffer starts on a multiple of this.
+  const int BUFFER_ALIGNMENT = 64;
+
+  /**
+   * Allocates a pixel or palette buffer of size bytes with the
+   * current allocator.  Returns 0 if the allocation fails.
+   */
+  byte* AllocateBuffer(int size); // Allocator.cpp
+
+  /**
+   * Frees a buffer from AllocateBuffer().  size must be the size it
+   * was allocated with.  Null pointers are ignored.
+   */
+  void FreeBuffer(void* buffer, int size); // Allocator.cpp
+
+  /**
+   * Returns the function that frees buffers from the current
+   * allocator, and stores the user data to pass it in user_data.
+   * Images hold on to these so they free their buffers the same way
+   * even if the allocator is changed later.
+   */
+  BufferDeleter GetBufferDeleter(void** user_data); // Allocator.cpp
+
+
+  /**
+   * Like auto_array, but for buffers from AllocateBuffer().  It
+   * remembers the size of the buffer so it can free it.
+   */
+  template<typename T>
+  class auto_buffer {
+  public:
+    auto_buffer() {
+      buffer = 0;
+      size = 0;
+    }
+
+    /// Allocates a buffer of size bytes.  Check for null afterwards.
+    explicit auto_buffer(int size) {
+      buffer = 0;
+      this->size = 0;
+      allocate(size);
+    }
+
+    ~auto_buffer() {
+      FreeBuffer(buffer, size);
+    }
+
+    /**
+     * Frees the current buffer and allocates a new one of s bytes.
+     *
+     * @return  the new buffer, or 0 if the allocation fails
+     */
+    T* allocate(int s) {
+      FreeBuffer(buffer, size);
+      buffer = (T*)AllocateBuffer(s);
+      size = (buffer ? s : 0);
+      return buffer;
+    }
+
+    operator T*() const {
+      return buffer;
+    }
+
+    T* get() const {
+      return buffer;
+    }
+
+    T* release() {
+      T* old = buffer;
+      buffer = 0;
+      size = 0;
+      return old;
+    }
+
+  private:
+    // not copyable
+    auto_buffer(const auto_buffer&);
+    auto_buffer& operator=(const auto_buffer&);
+
+    T* buffer;
+    int size;
+  };
+
+}
+
+
+#endif
@@ -0,0 +1,147 @@
+#include <string.h>
+#include "BufferedFile.h"
+
+
+namespace corona {
+
+  BufferedFile::BufferedFile(File* file)
+  : m_file(file)
+  {
+    int size;
+    const byte* contents = (const byte*)file->getContents(&size);
+    if (contents) {
+      m_base  = contents;
+      m_start = 0;
+      m_next  = contents + file->tell();
+      m_end   = contents + size;
+    } else {
+      m_buffer = new byte[BUFFER_SIZE];
+      m_base  = m_buffer;
+      m_start = file->tell();
+      m_next  = m_base;
+      m_end   = m_base;
+    }
+  }
+
+
+  BufferedFile::~BufferedFile() {
+    if (!m_buffer || m_next != m_end) {
+      m_file->seek(tell(), BEGIN);
+    }
+  }
+
+
+  int COR_CALL BufferedFile::read(void* buffer, int size) {
+    byte* out = (byte*)buffer;
+    int total = 0;
+    while (size > 0) {
+      int available = m_end - m_next;
+      if (available == 0) {
+
+        // big reads skip the buffer
+        if (m_buffer && size >= BUFFER_SIZE) {
+          m_start += m_end - m_base;
+          m_next = m_end = m_base;
+          const int read = m_file->read(out, size);
+          if (read > 0) {
+            m_start += read;
+            total += read;
+          }
+          return total;
+        }
+
+        if (!refill()) {
+          break;
+        }
+        available = m_end - m_next;
+      }
+
+      const int count = std::min(available, size);
+      memcpy(out, m_next, count);
+      m_next += count;
+      out    += count;
+      total  += count;
+      size   -= count;
+    }
+    return total;
+  }
+
+
+  int COR_CALL BufferedFile::write(const void* /*buffer*/, int /*size*/) {
+    return 0;
+  }
+
+
+  bool COR_CALL BufferedFile::seek(int position, SeekMode mode) {
+    const int block_size = m_end - m_base;
+
+    int target;
+    switch (mode) {
+      case BEGIN:   target = position;          break;
+      case CURRENT: target = tell() + position; break;
+
+      case END:
+        if (!m_buffer) {
+          target = block_size + position;
+          break;
+        }
+
+        // we don't know where the end is, so let the file work it out
+        if (!m_file->seek(position, END)) {
+          return false;
+        }
+        m_start = m_file->tell();
+        m_next = m_end = m_base;
+        return true;
+
+      default:
+        return false;
+    }
+
+    // stay in the block if we can
+    if (target >= m_start && target <= m_start + block_size) {
+      m_next = m_base + (target - m_start);
+      return true;
+    }
+
+    if (!m_buffer || !m_file->seek(target, BEGIN)) {
+      return false;
+    }
+    m_start = target;
+    m_next = m_end = m_base;
+    return true;
+  }
+
+
+  int COR_CALL BufferedFile::tell() {
+    return m_start + (m_next - m_base);
+  }
+
+
+  const void* COR_CALL BufferedFile::getContents(int* size) {
+    if (m_buffer) {
+      return 0;
+    }
+    *size = m_end - m_base;
+    return m_base;
+  }
+
+
+  bool BufferedFile::refill() {
+    // the whole file is already in the block
+    if (!m_buffer) {
+      return false;
+    }
+
+    m_start += m_end - m_base;
+    m_next = m_end = m_base;
+
+    const int read = m_file->read(m_buffer, BUFFER_SIZE);
+    if (read <= 0) {
+      return false;
+    }
+    m_end = m_base + read;
+    return true;
+  }
+
+}
@@ -0,0 +1,69 @@
+#ifndef CORONA_BUFFERED_FILE_H
+#define CORONA_BUFFERED_FILE_H
+
+
+#include "corona.h"
+#include "Types.h"
+#include "Utility.h"
+
+
+namespace corona {
+
+  /**
+   * A read-only File that reads another File a large block at a time.
+   * Loaders that parse their input a byte at a time use readByte(),
+   * which is inline and only calls into the underlying file when the
+   * buffer runs out.  Since it's a File itself, it can also be handed
+   * to code that expects one.
+   *
+   * If the underlying file is already in memory (see
+   * File::getContents()), its contents are used as the buffer and
+   * nothing is copied.
+   *
+   * Seeking within the buffered block doesn't touch the underlying
+   * file.  When the BufferedFile goes away, the underlying file is left
+   * at the position the last read or seek would have left it at.
+   */
+  class BufferedFile : public DLLImplementation<File> {
+  public:
+    enum { BUFFER_SIZE = 32 * 1024 };
+
+    BufferedFile(File* file);
+    ~BufferedFile();
+
+    /// Reads one byte.  Returns false at the end of the file.
+    bool readByte(byte& b) {
+      if (m_next == m_end && !refill()) {
+        return false;
+      }
+      b = *m_next++;
+      return true;
+    }
+
+    int  COR_CALL read(void* buffer, int size);
+    int  COR_CALL write(const void* buffer, int size);
+    bool COR_CALL seek(int position, SeekMode mode);
+    int  COR_CALL tell();
+    const void* COR_CALL getContents(int* size);
+
+  private:
+    bool refill();
+
+    File* m_file;
+    auto_array<byte> m_buffer;  ///< 0 if the file is in memory
+
+    /// The block being read: m_buffer, or the file's contents.
+    const byte* m_base;
+
+    /// Position of m_base[0] in the underlying file.  When buffering,
+    /// the underlying file is always at m_start + (m_end - m_base).
+    int m_start;
+
+    const byte* m_next;  ///< next byte to return
+    const byte* m_end;   ///< end of the valid data in the block
+  };
+
+}
+
+
+#endif
@@ -3,10 +3,12 @@
  * @todo  allow conversions from direct color images to
  *        palettized images
  */
-#include <map>
+#include <algorithm>
 #include <utility>
 #include <string.h>
 #include "corona.h"
+#include "Allocator.h"
+#include "Convert.h"
 #include "Debug.h"
 #include "SimpleImage.h"
 #include "Utility.h"
@@ -14,66 +16,180 @@
 
 namespace corona {
 
-  Image* ExpandPalette(Image* image) {
-    COR_GUARD("ExpandPalette()");
+  /**
+   * Compile-time description of each direct color format.  The
+   * channel members are byte offsets within a pixel.  In the case of
+   * RGBA, r is 0, g is 1, ...  Greyscale formats read their luminance
+   * as all three colors.
+   */
+  template<PixelFormat format> struct FormatTraits { };
+
+  template<> struct FormatTraits<PF_R8G8B8A8> {
+    enum { size = 4, r = 0, g = 1, b = 2, a = 3, has_alpha = true,
+           grey = false };
+  };
 
-    // assert isPalettized(image->getFormat())
+  template<> struct FormatTraits<PF_R8G8B8> {
+    enum { size = 3, r = 0, g = 1, b = 2, a = 0, has_alpha = false,
+           grey = false };
+  };
 
-    const int width                  = image->getWidth();
-    const int height                 = image->getHeight();
-    const byte* in                   = (byte*)image->getPixels();
-    const PixelFormat palette_format = image->getPaletteFormat();
-    const int pixel_size             = GetPixelSize(palette_format);
-    const byte* palette              = (byte*)image->getPalette();
-
-    byte* pixels = new byte[width * height * pixel_size];
-    byte* out = pixels;
-    for (int i = 0; i < width * height; ++i) {
-      memcpy(out, palette + (*in) * pixel_size, pixel_size);
-      out += pixel_size;
-      ++in;
-    }
-    delete image;
-    return new SimpleImage(width, height, palette_format, pixels);
+  template<> struct FormatTraits<PF_B8G8R8A8> {
+    enum { size = 4, r = 2, g = 1, b = 0, a = 3, has_alpha = true,
+           grey = false };
+  };
+
+  template<> struct FormatTraits<PF_B8G8R8> {
+    enum { size = 3, r = 2, g = 1, b = 0, a = 0, has_alpha = false,
+           grey = false };
+  };
+
+  template<> struct FormatTraits<PF_L8> {
+    enum { size = 1, r = 0, g = 0, b = 0, a = 0, has_alpha = false,
+           grey = true };
+  };
+
+  template<> struct FormatTraits<PF_L8A8> {
+    enum { size = 2, r = 0, g = 0, b = 0, a = 1, has_alpha = true,
+           grey = true };
+  };
+
+
+  // formats are numbered consecutively, so they can index the tables
+  const int FORMAT_BASE  = PF_R8G8B8A8;
+  const int FORMAT_COUNT = PF_L8A8 - PF_R8G8B8A8 + 1;
+
+
+  /// The Rec. 601 luma of a color, the weights libjpeg uses, in 8.8
+  /// fixed point.
+  inline byte Luminance(int r, int g, int b) {
+    return byte((r * 77 + g * 150 + b * 29 + 128) >> 8);
+  }
+
+  inline int FormatIndex(PixelFormat format) {
+    const int index = format - FORMAT_BASE;
+    return (index >= 0 && index < FORMAT_COUNT ? index : -1);
   }
 
 
-  struct FormatDesc {
-    FormatDesc(int r, int g, int b, int a, bool ha) {
-      r_shift = r;
-      g_shift = g;
-      b_shift = b;
-      a_shift = a;
-      has_alpha = ha;
+  /**
+   * The vector kernel for each pair, if the processor has one.  It is
+   * filled in by a static initializer, before any thread can convert.
+   * Until then the table is zeroed and everything converts one pixel
+   * at a time.
+   */
+  struct KernelTable {
+    ConvertKernel kernels[FORMAT_COUNT][FORMAT_COUNT];
+
+    KernelTable() {
+      for (int o = 0; o < FORMAT_COUNT; ++o) {
+        for (int i = 0; i < FORMAT_COUNT; ++i) {
+          kernels[o][i] = GetSIMDKernel(PixelFormat(FORMAT_BASE + o),
+                                        PixelFormat(FORMAT_BASE + i));
+        }
+      }
     }
+  };
+
+  static const KernelTable g_kernels;
+
+  ConvertKernel GetKernel(PixelFormat out_format, PixelFormat in_format) {
+    return g_kernels.kernels[out_format - FORMAT_BASE]
+                            [in_format - FORMAT_BASE];
+  }
+
 
-    // shifts are in bytes from the right
-    // In the case of RGBA, r_shift is 0, g_shift is 1, ...
-    int r_shift;
-    int g_shift;
-    int b_shift;
-    int a_shift;
-    bool has_alpha;
+  /**
+   * The conversion loop for one (source, target) pair.  Since the
+   * formats are template parameters, the offsets are constants and
+   * the compiler can unroll and vectorize each instantiation.
+   *
+   * (A class template instead of a function template because VC6
+   * can't tell function template instantiations apart when the
+   * template arguments don't appear in the parameter list.)
+   */
+  template<PixelFormat Out, PixelFormat In>
+  struct DirectConverter {
+    typedef FormatTraits<Out> O;
+    typedef FormatTraits<In>  I;
+
+    static void convert(byte* out, const byte* in, int pixel_count) {
+      if (Out == In) {
+        memcpy(out, in, pixel_count * I::size);
+        return;
+      }
+
+      // let the vector unit do the bulk of the work if it can, and
+      // finish whatever it leaves over one pixel at a time
+      ConvertKernel kernel = GetKernel(Out, In);
+      if (kernel) {
+        const int converted = kernel(out, in, pixel_count);
+        out         += converted * O::size;
+        in          += converted * I::size;
+        pixel_count -= converted;
+      }
+
+      for (int i = 0; i < pixel_count; ++i) {
+        const byte r = in[I::r];
+        const byte g = in[I::g];
+        const byte b = in[I::b];
+        const byte a = (I::has_alpha ? in[I::a] : 255);
+
+        if (!O::grey) {
+          out[O::r] = r;
+          out[O::g] = g;
+          out[O::b] = b;
+        } else if (I::grey) {
+          out[0] = r;
+        } else {
+          out[0] = Luminance(r, g, b);
+        }
+        if (O::has_alpha) {
+          out[O::a] = a;
+        }
+
+        in  += I::size;
+        out += O::size;
+      }
+    }
   };
 
 
-  #define DEFINE_DESC(format, desc)          \
-    case format: {                           \
-      COR_LOG(#format);                      \
-      static FormatDesc format##_desc desc;  \
-      return &format##_desc;                 \
+  #define CONVERTER(out, in) DirectConverter<out, in>::convert
+
+  #define CONVERTER_ROW(out) {          \
+      CONVERTER(out, PF_R8G8B8A8),      \
+      CONVERTER(out, PF_R8G8B8),        \
+      0, /* PF_I8 */                    \
+      CONVERTER(out, PF_B8G8R8A8),      \
+      CONVERTER(out, PF_B8G8R8),        \
+      CONVERTER(out, PF_L8),            \
+      CONVERTER(out, PF_L8A8),          \
     }
 
-  FormatDesc* GetDescription(PixelFormat format) {
-    // assert isDirect(image->getFormat())
+  /// g_converters[out][in] converts from in to out
+  static const PixelConverter g_converters[FORMAT_COUNT][FORMAT_COUNT] = {
+    CONVERTER_ROW(PF_R8G8B8A8),
+    CONVERTER_ROW(PF_R8G8B8),
+    { 0, 0, 0, 0, 0, 0, 0 },  // PF_I8
+    CONVERTER_ROW(PF_B8G8R8A8),
+    CONVERTER_ROW(PF_B8G8R8),
+    CONVERTER_ROW(PF_L8),
+    CONVERTER_ROW(PF_L8A8),
+  };
+
+  #undef CONVERTER_ROW
+  #undef CONVERTER
+
 
-    switch (format) {
-      DEFINE_DESC(PF_R8G8B8A8, (0, 1, 2, 3, true));
-      DEFINE_DESC(PF_R8G8B8,   (0, 1, 2, 0, false));
-      DEFINE_DESC(PF_B8G8R8A8, (2, 1, 0, 3, true));
-      DEFINE_DESC(PF_B8G8R8,   (2, 1, 0, 0, false));
-      default: return 0;
+  PixelConverter GetConverter(PixelFormat out_format, PixelFormat in_format) {
+    const int o = FormatIndex(out_format);
+    const int i = FormatIndex(in_format);
+    if (o < 0 || i < 0) {
+      return 0;
     }
+
+    return g_converters[o][i];
   }
 
 
@@ -81,36 +197,213 @@ namespace corona {
                      const byte* in,  PixelFormat in_format,
                      int pixel_count)
   {
-    const FormatDesc* out_desc = GetDescription(out_format);
-    const FormatDesc* in_desc  = GetDescription(in_format);
-    if (!out_desc || !in_desc) {
+    PixelConverter converter = GetConverter(out_format, in_format);
+    if (!converter) {
       return false;
     }
 
-    const int out_size = GetPixelSize(out_format);
-    const int in_size  = GetPixelSize(in_format);
+    converter(out, in, pixel_count);
+    return true;
+  }
 
-    for (int i = 0; i < pixel_count; ++i) {
-      out[out_desc->r_shift] = in[in_desc->r_shift];
-      out[out_desc->g_shift] = in[in_desc->g_shift];
-      out[out_desc->b_shift] = in[in_desc->b_shift];
 
-      if (out_desc->has_alpha) {
-        if (in_desc->has_alpha) {
-          out[out_desc->a_shift] = in[in_desc->a_shift];
-        } else {
-          out[out_desc->a_shift] = 255;
-        }
+  bool ConvertRows(byte* out, PixelFormat out_format, int out_pitch,
+                   const byte* in, PixelFormat in_format, int in_pitch,
+                   int width, int height)
+  {
+    PixelConverter converter = GetConverter(out_format, in_format);
+    if (!converter) {
+      return false;
+    }
+
+    if (out_pitch == width * GetPixelSize(out_format) &&
+        in_pitch  == width * GetPixelSize(in_format))
+    {
+      converter(out, in, width * height);
+    } else {
+      for (int h = 0; h < height; ++h) {
+        converter(out + h * out_pitch, in + h * in_pitch, width);
+      }
+    }
+    return true;
+  }
+
+
+  void CopyRows(byte* out, int out_pitch,
+                const byte* in, int in_pitch,
+                int row_size, int height)
+  {
+    if (out_pitch == row_size && in_pitch == row_size) {
+      memcpy(out, in, row_size * height);
+    } else {
+      for (int h = 0; h < height; ++h) {
+        memcpy(out + h * out_pitch, in + h * in_pitch, row_size);
       }
+    }
+  }
+
 
-      in  += in_size;
-      out += out_size;
+  /**
+   * Looks count indices up in a table of 256 four-byte entries,
+   * writing pixel_size bytes per pixel.
+   */
+  void LookupPixels(byte* out, const byte* in, const byte* table,
+                    int pixel_size, int count)
+  {
+    int i = 0;
+    LookupKernel kernel = GetSIMDLookupKernel(pixel_size);
+    if (kernel) {
+      i = kernel(out, in, table, count);
+      out += i * pixel_size;
     }
 
+    if (pixel_size == 4) {
+      for (; i < count; ++i) {
+        memcpy(out, table + in[i] * 4, 4);
+        out += 4;
+      }
+    } else if (pixel_size == 3) {
+      // the next pixel overwrites the extra byte, except after the
+      // last one, which gets copied exactly
+      for (; i < count - 1; ++i) {
+        memcpy(out, table + in[i] * 4, 4);
+        out += pixel_size;
+      }
+      if (i < count) {
+        memcpy(out, table + in[i] * 4, pixel_size);
+      }
+    } else {
+      for (; i < count; ++i) {
+        memcpy(out, table + in[i] * 4, pixel_size);
+        out += pixel_size;
+      }
+    }
+  }
+
+
+  bool RowConverter::init(PixelFormat out_format, PixelFormat in_format,
+                          const void* palette, int palette_size,
+                          PixelFormat palette_format)
+  {
+    m_pixel_size = GetPixelSize(out_format);
+
+    if (IsDirect(in_format)) {
+      m_converter = GetConverter(out_format, in_format);
+      return m_converter != 0;
+    }
+
+    m_converter = 0;
+    PixelConverter converter = GetConverter(out_format, palette_format);
+    if (!IsPalettized(in_format) || !converter || !palette) {
+      return false;
+    }
+
+    // Convert the palette once, then spread it out to four bytes per
+    // entry, so every pixel is a single 32-bit copy.  Indices past the
+    // end of the palette come out black.
+    palette_size = std::min(palette_size, 256);
+    byte converted[256 * 4];
+    converter(converted, (const byte*)palette, palette_size);
+
+    memset(m_table, 0, sizeof(m_table));
+    for (int i = 0; i < palette_size; ++i) {
+      memcpy(m_table + i * 4, converted + i * m_pixel_size, m_pixel_size);
+    }
+    return true;
+  }
+
+
+  void RowConverter::convert(byte* out, const byte* in,
+                             int pixel_count) const
+  {
+    if (m_converter) {
+      m_converter(out, in, pixel_count);
+    } else {
+      LookupPixels(out, in, m_table, m_pixel_size, pixel_count);
+    }
+  }
+
+
+  bool CanDecodeInto(Image* target, int width, int height) {
+    return (target &&
+            IsDirect(target->getFormat()) &&
+            target->getWidth()  == width &&
+            target->getHeight() == height);
+  }
+
+
+  bool ConvertInto(Image* target, Image* source) {
+    COR_GUARD("ConvertInto()");
+
+    const int width  = source->getWidth();
+    const int height = source->getHeight();
+    if (!CanDecodeInto(target, width, height)) {
+      return false;
+    }
+
+    const PixelFormat format = source->getFormat();
+    const byte* in = (const byte*)source->getPixels();
+    byte* out = (byte*)target->getPixels();
+    if (IsDirect(format)) {
+      return ConvertRows(out, target->getFormat(), target->getPitch(),
+                         in, format, source->getPitch(),
+                         width, height);
+    }
+
+    RowConverter converter;
+    if (!converter.init(target->getFormat(), format,
+                        source->getPalette(), source->getPaletteSize(),
+                        source->getPaletteFormat()))
+    {
+      return false;
+    }
+    for (int h = 0; h < height; ++h) {
+      converter.convert(out + h * target->getPitch(),
+                        in  + h * source->getPitch(),
+                        width);
+    }
     return true;
   }
 
 
+  byte* ExpandPalette(Image* image, PixelFormat target_format) {
+    COR_GUARD("ExpandPalette()");
+
+    // assert isPalettized(image->getFormat())
+
+    const int width  = image->getWidth();
+    const int height = image->getHeight();
+
+    RowConverter converter;
+    if (!converter.init(target_format, image->getFormat(),
+                        image->getPalette(), image->getPaletteSize(),
+                        image->getPaletteFormat()))
+    {
+      return 0;
+    }
+
+    const int pixel_size = GetPixelSize(target_format);
+    byte* pixels = AllocateBuffer(width * height * pixel_size);
+    if (!pixels) {
+      return 0;
+    }
+
+    // indices are one byte each
+    const byte* in  = (const byte*)image->getPixels();
+    const int pitch = image->getPitch();
+    if (pitch == width) {
+      converter.convert(pixels, in, width * height);
+    } else {
+      for (int h = 0; h < height; ++h) {
+        converter.convert(pixels + h * width * pixel_size, in + h * pitch,
+                          width);
+      }
+    }
+
+    return pixels;
+  }
+
+
   Image* DirectConversion(Image* image, PixelFormat target_format) {
     COR_GUARD("DirectConversion()");
 
@@ -119,28 +412,89 @@ namespace corona {
     const int width                 = image->getWidth();
     const int height                = image->getHeight();
     const PixelFormat source_format = image->getFormat();
-    const byte* in                  = (byte*)image->getPixels();
+    byte* in                        = (byte*)image->getPixels();
 
     if (source_format == target_format) {
         return image;
     }
 
+    if (!GetConverter(target_format, source_format)) {
+      delete image;
+      return 0;
+    }
+
+    // If the pixels stay the same size and the image is one of ours,
+    // rewrite the buffer in place rather than allocating another one.
+    // (The converters read each pixel before writing it.)  Buffers
+    // the caller still owns are left alone.  Rows keep their pitch.
+    const int pitch = image->getPitch();
     const int target_size = GetPixelSize(target_format);
-    byte* out_pixels = new byte[width * height * target_size];
-    if (!ConvertPixels(out_pixels, target_format,
-                       in, source_format,
-                       width * height))
+    SimpleImage* simple = dynamic_cast<SimpleImage*>(image);
+    if (simple && simple->ownsPixels() &&
+        GetPixelSize(source_format) == target_size)
     {
-      delete[] out_pixels;
+      COR_LOG("Converting in place");
+      ConvertRows(in, target_format, pitch,
+                  in, source_format, pitch,
+                  width, height);
+      simple->setFormat(target_format);
+      return image;
+    }
+
+    byte* out_pixels = AllocateBuffer(width * height * target_size);
+    if (!out_pixels) {
       delete image;
       return 0;
     }
+    ConvertRows(out_pixels, target_format, width * target_size,
+                in, source_format, pitch,
+                width, height);
 
     delete image;
     return new SimpleImage(width, height, target_format, out_pixels);
   }
 
 
+  /**
+   * Flips height rows of width pixels, pitch bytes apart, around the
+   * axes in coordinate_axis.
+   */
+  static void FlipPixels(byte* pixels, int width, int height, int pitch,
+                         int pixel_size, int coordinate_axis)
+  {
+    // flip about the X axis
+    if (coordinate_axis & CA_X) {
+
+      byte* row = new byte[width * pixel_size];
+      for (int h = 0; h < height / 2; ++h) {
+        byte* top = pixels + h                * pitch;
+        byte* bot = pixels + (height - h - 1) * pitch;
+        memcpy(row, top, width * pixel_size);
+        memcpy(top, bot, width * pixel_size);
+        memcpy(bot, row, width * pixel_size);
+      }
+      delete[] row;
+
+    }
+
+    // flip about the Y axis
+    if (coordinate_axis & CA_Y) {
+
+      for (int h = 0; h < height; ++h) {
+        byte* row = pixels + h * pitch;
+        for (int w = 0; w < width / 2; ++w) {
+          byte* left  = row + w               * pixel_size;
+          byte* right = row + (width - w - 1) * pixel_size;
+          for (int b = 0; b < pixel_size; ++b) {
+            std::swap(left[b], right[b]);
+          }
+        }
+      }
+
+    }
+  }
+
+
   namespace hidden {
 
     COR_EXPORT(Image*) CorConvertImage(
@@ -160,10 +514,16 @@ namespace corona {
 
       COR_LOG("Doing the conversion...");
 
-      // if we have a palettized image, convert it to a direct color
-      // image and then convert that
+      // if we have a palettized image, look each index up in a copy
+      // of the palette that has already been converted
       if (IsPalettized(image->getFormat())) {
-        image = ExpandPalette(image);
+        const int width  = image->getWidth();
+        const int height = image->getHeight();
+        byte* pixels = ExpandPalette(image, target_format);
+        delete image;
+        return (pixels ?
+                new SimpleImage(width, height, target_format, pixels) :
+                0);
       }
 
       return DirectConversion(image, target_format);
@@ -196,27 +556,31 @@ namespace corona {
       const int palette_size = image->getPaletteSize();
 
       // the palette indices don't change, so just make a copy
-      const int image_size = width * height * GetPixelSize(format);
-      byte* pixels = new byte[image_size];
-      memcpy(pixels, image->getPixels(), image_size);
+      const int row_size = width * GetPixelSize(format);
+      auto_buffer<byte> pixels(row_size * height);
+      auto_buffer<byte> new_palette(
+        palette_size * GetPixelSize(palette_format));
+      if (!pixels || !new_palette) {
+        delete image;
+        return 0;
+      }
 
-      byte* new_palette = new byte[
-        palette_size * GetPixelSize(palette_format)];
+      CopyRows(pixels, row_size,
+               (const byte*)image->getPixels(), image->getPitch(),
+               row_size, height);
 
       if (!ConvertPixels(new_palette, palette_format,
                          (byte*)image->getPalette(), image->getPaletteFormat(),
                          palette_size))
       {
         delete image;
-        delete[] pixels;
-        delete[] new_palette;
         return 0;
       }
 
       delete image;
       return new SimpleImage(
-        width, height, format, pixels,
-        new_palette, palette_size, palette_format);
+        width, height, format, pixels.release(),
+        new_palette.release(), palette_size, palette_format);
     }
 
     COR_EXPORT(Image*) CorFlipImage(
@@ -236,39 +600,22 @@ namespace corona {
       const int height               = image->getHeight();
       byte* pixels                   = (byte*)image->getPixels();
       const PixelFormat pixel_format = image->getFormat();
-      const int pixel_size           = GetPixelSize(pixel_format);
-
-      // flip about the X axis
-      if (coordinate_axis & CA_X) {
-
-        byte* row = new byte[width * pixel_size];
-        for (int h = 0; h < height / 2; ++h) {
-          byte* top = pixels + h                * width * pixel_size;
-          byte* bot = pixels + (height - h - 1) * width * pixel_size;
-          memcpy(row, top, width * pixel_size);
-          memcpy(top, bot, width * pixel_size);
-          memcpy(bot, row, width * pixel_size);
-        }
-        delete[] row;
 
-      }
-
-      // flip about the Y axis
-      if (coordinate_axis & CA_Y) {
-
-        for (int h = 0; h < height; ++h) {
-          byte* row = pixels + h * width * pixel_size;
-          for (int w = 0; w < width / 2; ++w) {
-            byte* left  = row + w               * pixel_size;
-            byte* right = row + (width - w - 1) * pixel_size;
-            for (int b = 0; b < pixel_size; ++b) {
-              std::swap(left[b], right[b]);
-            }
-          }
+      // each plane is flipped on its own.  subsampled planes of odd
+      // size end up half a sample off from the Y plane
+      if (IsPlanar(pixel_format)) {
+        for (int c = 0; c < 3; ++c) {
+          const int plane_width = GetPlaneWidth(pixel_format, width, c);
+          FlipPixels((byte*)GetPlane(image, c),
+                     plane_width,
+                     GetPlaneHeight(pixel_format, height, c),
+                     plane_width, 1, coordinate_axis);
         }
-
+        return image;
       }
 
+      FlipPixels(pixels, width, height, image->getPitch(),
+                 GetPixelSize(pixel_format), coordinate_axis);
       return image;
     }
   }
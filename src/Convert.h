@@ -0,0 +1,127 @@
+#ifndef CORONA_CONVERT_H
+#define CORONA_CONVERT_H
+
+
+#include "corona.h"
+#include "Types.h"
+
+
+namespace corona {
+
+  /**
+   * Converts pixel_count tightly packed pixels from one direct color
+   * format to another.  If both formats have the same pixel size, out
+   * may point at the same buffer as in.
+   */
+  typedef void (*PixelConverter)(byte* out, const byte* in, int pixel_count);
+
+  /**
+   * Looks up the converter specialized for the given pair of direct
+   * color formats.  Returns 0 if either format is not direct color.
+   */
+  PixelConverter GetConverter(PixelFormat out_format,
+                              PixelFormat in_format); // Convert.cpp
+
+  /**
+   * Convenience wrapper around GetConverter().  Returns false if there
+   * is no converter for the pair.
+   */
+  bool ConvertPixels(byte* out, PixelFormat out_format,
+                     const byte* in, PixelFormat in_format,
+                     int pixel_count); // Convert.cpp
+
+  /**
+   * Like ConvertPixels(), but for height rows of width pixels whose
+   * starts are out_pitch and in_pitch bytes apart.  Tightly packed
+   * rows are converted in one go.
+   */
+  bool ConvertRows(byte* out, PixelFormat out_format, int out_pitch,
+                   const byte* in, PixelFormat in_format, int in_pitch,
+                   int width, int height); // Convert.cpp
+
+  /**
+   * Copies height rows of row_size bytes between buffers with the
+   * given pitches.
+   */
+  void CopyRows(byte* out, int out_pitch,
+                const byte* in, int in_pitch,
+                int row_size, int height); // Convert.cpp
+
+  /**
+   * Converts rows of one pixel format into another, one row at a
+   * time, for code that can't convert the whole image at once.
+   * Palettized rows are looked up in a table built from the palette,
+   * so the palette is only converted once.
+   */
+  class RowConverter {
+  public:
+    /**
+     * Prepares to convert in_format pixels (with the given palette,
+     * if they are palettized) to out_format, which must be direct
+     * color.  Returns false if there is no such conversion.
+     */
+    bool init(PixelFormat out_format, PixelFormat in_format,
+              const void* palette = 0, int palette_size = 0,
+              PixelFormat palette_format = PF_DONTCARE);
+
+    void convert(byte* out, const byte* in, int pixel_count) const;
+
+  private:
+    PixelConverter m_converter;  // 0 if looking up in m_table
+    int m_pixel_size;
+    byte m_table[256 * 4];
+  };
+
+  /**
+   * Returns true if target is a direct color image that width by
+   * height pixels can be decoded into.
+   */
+  bool CanDecodeInto(Image* target, int width, int height); // Convert.cpp
+
+  /**
+   * Converts all of source into target, which must have the same
+   * dimensions and a direct color format.
+   */
+  bool ConvertInto(Image* target, Image* source); // Convert.cpp
+
+  /**
+   * Converts the indices of a palettized image into a new, tightly
+   * packed buffer of target_format pixels.  Returns 0 if the palette can't be converted
+   * to target_format.  Does not destroy the image.
+   */
+  byte* ExpandPalette(Image* image, PixelFormat target_format); // Convert.cpp
+
+  /**
+   * A vectorized conversion routine for one (source, target) pixel
+   * format pair.  Kernels only handle whole vector blocks, so they
+   * return the number of pixels they converted.  The caller converts
+   * the remaining pixels itself.  Like PixelConverter, kernels between
+   * formats of the same size can run in place.
+   */
+  typedef int (*ConvertKernel)(byte* out, const byte* in, int pixel_count);
+
+  /**
+   * Returns the fastest kernel the processor supports for converting
+   * in_format pixels to out_format, or 0 if there isn't one.
+   */
+  ConvertKernel GetSIMDKernel(PixelFormat out_format,
+                              PixelFormat in_format); // ConvertSIMD.cpp
+
+  /**
+   * A vectorized palette lookup.  table has 256 entries of four bytes
+   * each, the first pixel_size bytes of which are the output pixel.
+   * Returns the number of pixels converted, like ConvertKernel.
+   */
+  typedef int (*LookupKernel)(byte* out, const byte* in, const byte* table,
+                              int pixel_count);
+
+  /**
+   * Returns the fastest lookup kernel for pixel_size-byte output
+   * pixels, or 0 if there isn't one.
+   */
+  LookupKernel GetSIMDLookupKernel(int pixel_size); // ConvertSIMD.cpp
+
+}
+
+
+#endif
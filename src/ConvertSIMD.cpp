@@ -0,0 +1,368 @@
+/**
+ * @file
+ * SSE2, SSSE3, and AVX2 versions of the direct color conversions and
+ * palette lookups in Convert.cpp.  The instruction set is picked at
+ * runtime, so the library still runs on processors without these
+ * extensions.
+ *
+ * Define NO_SIMD to build without any of this.  The GetSIMD*
+ * functions then always return 0 and the scalar code does all the
+ * work.
+ */
+
+#include "Convert.h"
+
+#if !defined(NO_SIMD) && defined(__GNUC__) &&                         \
+    (defined(__i386__) || defined(__x86_64__)) &&                     \
+    (defined(__clang__) || __GNUC__ > 4 ||                            \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#  define COR_SIMD_GCC
+#elif !defined(NO_SIMD) && defined(_MSC_VER) && _MSC_VER >= 1700 &&   \
+    (defined(_M_IX86) || defined(_M_X64))
+#  define COR_SIMD_MSVC
+#endif
+
+#if defined(COR_SIMD_GCC) || defined(COR_SIMD_MSVC)
+#  define COR_SIMD
+#  include <immintrin.h>
+#  ifdef COR_SIMD_MSVC
+#    include <intrin.h>
+#  endif
+#endif
+
+// gcc and clang only emit instructions for the extensions enabled on
+// the command line, unless the function asks for more
+#ifdef COR_SIMD_GCC
+#  define COR_TARGET_SSE2  __attribute__((target("sse2")))
+#  define COR_TARGET_SSSE3 __attribute__((target("ssse3")))
+#  define COR_TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#  define COR_TARGET_SSE2
+#  define COR_TARGET_SSSE3
+#  define COR_TARGET_AVX2
+#endif
+
+
+namespace corona {
+
+#ifdef COR_SIMD
+
+  enum {
+    CPU_SSE2  = 0x01,
+    CPU_SSSE3 = 0x02,
+    CPU_AVX2  = 0x04,
+  };
+
+  int DetectCPUFeatures() {
+    int features = 0;
+
+#ifdef COR_SIMD_GCC
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))  { features |= CPU_SSE2;  }
+    if (__builtin_cpu_supports("ssse3")) { features |= CPU_SSSE3; }
+    if (__builtin_cpu_supports("avx2"))  { features |= CPU_AVX2;  }
+#else
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26)) { features |= CPU_SSE2;  }
+    if (info[2] & (1 << 9))  { features |= CPU_SSSE3; }
+
+    // AVX2 also needs the OS to save the upper halves of the registers
+    const bool os_saves_ymm = (info[2] & (1 << 27)) &&
+                              (_xgetbv(0) & 6) == 6;
+    if (max_leaf >= 7 && os_saves_ymm) {
+      __cpuidex(info, 7, 0);
+      if (info[1] & (1 << 5)) { features |= CPU_AVX2; }
+    }
+#endif
+
+    return features;
+  }
+
+  int GetCPUFeatures() {
+    static const int features = DetectCPUFeatures();
+    return features;
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  // pshufb masks for four pixels (one 128-bit lane).  If Swap is
+  // true, red and blue trade places.  -1 zeroes the output byte.
+
+  template<bool Swap>
+  COR_TARGET_SSE2 inline __m128i ExpandMask() {  // 3 bytes -> 4 bytes
+    const char r = (Swap ? 2 : 0);
+    const char b = (Swap ? 0 : 2);
+    return _mm_setr_epi8(r,     1,  b,     -1,  3 + r, 4,  3 + b, -1,
+                         6 + r, 7,  6 + b, -1,  9 + r, 10, 9 + b, -1);
+  }
+
+  template<bool Swap>
+  COR_TARGET_SSE2 inline __m128i PackMask() {    // 4 bytes -> 3 bytes
+    const char r = (Swap ? 2 : 0);
+    const char b = (Swap ? 0 : 2);
+    return _mm_setr_epi8(r,     1, b,      4 + r,  5,  4 + b,
+                         8 + r, 9, 8 + b,  12 + r, 13, 12 + b,
+                         -1, -1, -1, -1);
+  }
+
+  // The last four bytes are passed through untouched, so a store
+  // that covers part of the next pixel writes back what was there.
+  COR_TARGET_SSE2 inline __m128i Swizzle3Mask() {
+    return _mm_setr_epi8(2, 1, 0,  5, 4, 3,  8, 7, 6,  11, 10, 9,
+                         12, 13, 14, 15);
+  }
+
+  COR_TARGET_SSE2 inline __m128i Swizzle4Mask() {
+    return _mm_setr_epi8(2,  1, 0, 3,   6,  5,  4, 7,
+                         10, 9, 8, 11,  14, 13, 12, 15);
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  // SSE2
+
+  COR_TARGET_SSE2
+  int Swizzle4_SSE2(byte* out, const byte* in, int pixel_count) {
+    // no byte shuffle in SSE2: mask out red and blue and swap the
+    // 16-bit halves of each pixel
+    const __m128i ga_mask = _mm_set1_epi32(int(0xFF00FF00));
+
+    int i = 0;
+    for (; i + 4 <= pixel_count; i += 4) {
+      __m128i v  = _mm_loadu_si128((const __m128i*)(in + i * 4));
+      __m128i ga = _mm_and_si128(v, ga_mask);
+      __m128i rb = _mm_andnot_si128(ga_mask, v);
+      rb = _mm_shufflehi_epi16(_mm_shufflelo_epi16(rb, 0xB1), 0xB1);
+      _mm_storeu_si128((__m128i*)(out + i * 4), _mm_or_si128(ga, rb));
+    }
+    return i;
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  // SSSE3
+  //
+  // The 3-byte side of these loops reads or writes 16 bytes for four
+  // pixels, so they stop while there are at least two pixels left.
+
+  template<bool Swap>
+  COR_TARGET_SSSE3
+  int Expand_SSSE3(byte* out, const byte* in, int pixel_count) {
+    const __m128i mask  = ExpandMask<Swap>();
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+
+    int i = 0;
+    for (; i + 6 <= pixel_count; i += 4) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(in + i * 3));
+      v = _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha);
+      _mm_storeu_si128((__m128i*)(out + i * 4), v);
+    }
+    return i;
+  }
+
+  template<bool Swap>
+  COR_TARGET_SSSE3
+  int Pack_SSSE3(byte* out, const byte* in, int pixel_count) {
+    const __m128i mask = PackMask<Swap>();
+
+    int i = 0;
+    for (; i + 6 <= pixel_count; i += 4) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(in + i * 4));
+      _mm_storeu_si128((__m128i*)(out + i * 3), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+  }
+
+  COR_TARGET_SSSE3
+  int Swizzle3_SSSE3(byte* out, const byte* in, int pixel_count) {
+    const __m128i mask = Swizzle3Mask();
+
+    int i = 0;
+    for (; i + 6 <= pixel_count; i += 4) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(in + i * 3));
+      _mm_storeu_si128((__m128i*)(out + i * 3), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  // AVX2
+  //
+  // vpshufb can't move bytes between 128-bit lanes, so 3-byte pixels
+  // are loaded and stored as two groups of four, one per lane.
+
+  COR_TARGET_AVX2 inline __m256i Broadcast(__m128i v) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(v), v, 1);
+  }
+
+  COR_TARGET_AVX2 inline __m256i Load3x8(const byte* in) {
+    return _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)in)),
+      _mm_loadu_si128((const __m128i*)(in + 12)), 1);
+  }
+
+  COR_TARGET_AVX2 inline void Store3x8(byte* out, __m256i v) {
+    // the high lane overwrites the low lane's four trailing bytes
+    _mm_storeu_si128((__m128i*)out,        _mm256_castsi256_si128(v));
+    _mm_storeu_si128((__m128i*)(out + 12), _mm256_extracti128_si256(v, 1));
+  }
+
+  COR_TARGET_AVX2
+  int Swizzle4_AVX2(byte* out, const byte* in, int pixel_count) {
+    const __m256i mask = Broadcast(Swizzle4Mask());
+
+    int i = 0;
+    for (; i + 8 <= pixel_count; i += 8) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(in + i * 4));
+      _mm256_storeu_si256((__m256i*)(out + i * 4),
+                          _mm256_shuffle_epi8(v, mask));
+    }
+    return i;
+  }
+
+  template<bool Swap>
+  COR_TARGET_AVX2
+  int Expand_AVX2(byte* out, const byte* in, int pixel_count) {
+    const __m256i mask  = Broadcast(ExpandMask<Swap>());
+    const __m256i alpha = _mm256_set1_epi32(int(0xFF000000));
+
+    int i = 0;
+    for (; i + 10 <= pixel_count; i += 8) {
+      __m256i v = Load3x8(in + i * 3);
+      v = _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha);
+      _mm256_storeu_si256((__m256i*)(out + i * 4), v);
+    }
+    return i;
+  }
+
+  template<bool Swap>
+  COR_TARGET_AVX2
+  int Pack_AVX2(byte* out, const byte* in, int pixel_count) {
+    const __m256i mask = Broadcast(PackMask<Swap>());
+
+    int i = 0;
+    for (; i + 10 <= pixel_count; i += 8) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(in + i * 4));
+      Store3x8(out + i * 3, _mm256_shuffle_epi8(v, mask));
+    }
+    return i;
+  }
+
+  COR_TARGET_AVX2
+  int Swizzle3_AVX2(byte* out, const byte* in, int pixel_count) {
+    const __m256i mask = Broadcast(Swizzle3Mask());
+
+    int i = 0;
+    for (; i + 10 <= pixel_count; i += 8) {
+      __m256i v = Load3x8(in + i * 3);
+      Store3x8(out + i * 3, _mm256_shuffle_epi8(v, mask));
+    }
+    return i;
+  }
+
+
+  // Palette lookups: widen eight indices to 32 bits and gather the
+  // table entries.
+
+  COR_TARGET_AVX2 inline __m256i Gather8(const byte* in, const byte* table) {
+    const __m256i indices = _mm256_cvtepu8_epi32(
+      _mm_loadl_epi64((const __m128i*)in));
+    return _mm256_i32gather_epi32((const int*)table, indices, 4);
+  }
+
+  COR_TARGET_AVX2
+  int Lookup4_AVX2(byte* out, const byte* in, const byte* table,
+                   int pixel_count) {
+    int i = 0;
+    for (; i + 8 <= pixel_count; i += 8) {
+      _mm256_storeu_si256((__m256i*)(out + i * 4), Gather8(in + i, table));
+    }
+    return i;
+  }
+
+  COR_TARGET_AVX2
+  int Lookup3_AVX2(byte* out, const byte* in, const byte* table,
+                   int pixel_count) {
+    // drop the fourth byte of each entry
+    const __m256i mask = Broadcast(PackMask<false>());
+
+    int i = 0;
+    for (; i + 10 <= pixel_count; i += 8) {
+      Store3x8(out + i * 3, _mm256_shuffle_epi8(Gather8(in + i, table), mask));
+    }
+    return i;
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  // size of the pixel in bytes, and whether blue comes before red
+  bool DescribeDirect(PixelFormat format, int& size, bool& bgr) {
+    switch (format) {
+      case PF_R8G8B8A8: size = 4; bgr = false; return true;
+      case PF_R8G8B8:   size = 3; bgr = false; return true;
+      case PF_B8G8R8A8: size = 4; bgr = true;  return true;
+      case PF_B8G8R8:   size = 3; bgr = true;  return true;
+      default:          return false;
+    }
+  }
+
+#endif
+
+
+  ConvertKernel GetSIMDKernel(PixelFormat out_format, PixelFormat in_format) {
+#ifdef COR_SIMD
+    int out_size, in_size;
+    bool out_bgr, in_bgr;
+    if (!DescribeDirect(out_format, out_size, out_bgr) ||
+        !DescribeDirect(in_format,  in_size,  in_bgr))
+    {
+      return 0;
+    }
+
+    const int  features = GetCPUFeatures();
+    const bool avx2     = (features & CPU_AVX2)  != 0;
+    const bool ssse3    = (features & CPU_SSSE3) != 0;
+    const bool swap     = (out_bgr != in_bgr);
+
+#define COR_PICK(kernel) (swap ? kernel<true> : kernel<false>)
+
+    if (in_size == 4 && out_size == 4 && swap) {
+      if (avx2)                    { return Swizzle4_AVX2;  }
+      if (features & CPU_SSE2)     { return Swizzle4_SSE2;  }
+    } else if (in_size == 3 && out_size == 3 && swap) {
+      if (avx2)                    { return Swizzle3_AVX2;  }
+      if (ssse3)                   { return Swizzle3_SSSE3; }
+    } else if (in_size == 3 && out_size == 4) {
+      if (avx2)                    { return COR_PICK(Expand_AVX2);  }
+      if (ssse3)                   { return COR_PICK(Expand_SSSE3); }
+    } else if (in_size == 4 && out_size == 3) {
+      if (avx2)                    { return COR_PICK(Pack_AVX2);    }
+      if (ssse3)                   { return COR_PICK(Pack_SSSE3);   }
+    }
+
+#undef COR_PICK
+#endif
+
+    return 0;
+  }
+
+
+  LookupKernel GetSIMDLookupKernel(int pixel_size) {
+#ifdef COR_SIMD
+    if (GetCPUFeatures() & CPU_AVX2) {
+      if (pixel_size == 4) { return Lookup4_AVX2; }
+      if (pixel_size == 3) { return Lookup3_AVX2; }
+    }
+#endif
+
+    return 0;
+  }
+
+}
@@ -9,6 +9,8 @@
 #include <string.h>
 #include <ctype.h>
 #include "corona.h"
+#include "Allocator.h"
+#include "Convert.h"
 #include "MemoryFile.h"
 #include "Open.h"
 #include "Save.h"
@@ -21,7 +23,7 @@ namespace corona {
     ///////////////////////////////////////////////////////////////////////////
 
     COR_EXPORT(const char*) CorGetVersion() {
-      return "1.0.2";
+      return "1.1.0";
     }
 
     ///////////////////////////////////////////////////////////////////////////
@@ -117,12 +119,19 @@ namespace corona {
       void* pixels)
     {
       // this function only supports creation of non-palettized images
-      if (!IsDirect(format)) {
+      int size;
+      if (IsDirect(format)) {
+        size = width * height * GetPixelSize(format);
+      } else if (IsPlanar(format)) {
+        size = GetPlaneOffset(format, width, height, 3);
+      } else {
         return 0;
       }
 
-      int size = width * height * GetPixelSize(format);
-      byte* p = new byte[size];
+      byte* p = AllocateBuffer(size);
+      if (!p) {
+        return 0;
+      }
       if (pixels) {
         memcpy(p, pixels, size);
       } else {
@@ -151,15 +160,105 @@ namespace corona {
       }
 
       int size = width * height * GetPixelSize(format);
-      byte* pixels = new byte[size];
-      memset(pixels, 0, size);
+      auto_buffer<byte> pixels(size);
 
       int palette_bytes = palette_size * GetPixelSize(palette_format);
-      byte* palette = new byte[palette_bytes];
+      auto_buffer<byte> palette(palette_bytes);
+
+      if (!pixels || !palette) {
+        return 0;
+      }
+      memset(pixels, 0, size);
       memset(palette, 0, palette_bytes);
 
-      return new SimpleImage(width, height, format, pixels,
-                             palette, palette_size, palette_format);      
+      return new SimpleImage(width, height, format, pixels.release(),
+                             palette.release(), palette_size, palette_format);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    COR_EXPORT(Image*) CorWrapImage(
+      int width,
+      int height,
+      PixelFormat format,
+      void* pixels,
+      int pitch,
+      void* palette,
+      int palette_size,
+      PixelFormat palette_format,
+      BufferDeleter deleter,
+      void* user_data)
+    {
+      if (!pixels || width < 0 || height < 0) {
+        return 0;
+      }
+
+      // planes are always tightly packed
+      const int row_size =
+        (IsPlanar(format) ? width : width * GetPixelSize(format));
+      if (pitch == 0) {
+        pitch = row_size;
+      } else if (pitch < row_size ||
+                 (IsPlanar(format) && pitch != row_size)) {
+        return 0;
+      }
+
+      SimpleImage* image;
+      if (IsDirect(format) || IsPlanar(format)) {
+        image = new SimpleImage(width, height, format, (byte*)pixels);
+      } else if (IsPalettized(format)) {
+        if (!palette ||
+            palette_size != GetPaletteSize(format) ||
+            !IsDirect(palette_format))
+        {
+          return 0;
+        }
+        image = new SimpleImage(width, height, format, (byte*)pixels,
+                                (byte*)palette, palette_size, palette_format);
+      } else {
+        return 0;
+      }
+
+      // nothing is known about how the caller allocated the buffers
+      image->setPitch(pitch);
+      image->setDeleter(deleter, user_data, 1);
+      return image;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    COR_EXPORT(Image*) CorCreateSubImage(
+      Image* parent,
+      int x,
+      int y,
+      int width,
+      int height)
+    {
+      if (!parent ||
+          x < 0 || y < 0 || width < 0 || height < 0 ||
+          x + width  > parent->getWidth() ||
+          y + height > parent->getHeight())
+      {
+        return 0;
+      }
+
+      const PixelFormat format = parent->getFormat();
+      const int pixel_size = GetPixelSize(format);
+      if (pixel_size == 0) {
+        return 0;
+      }
+
+      const int pitch = parent->getPitch();
+      byte* pixels = (byte*)parent->getPixels() + y * pitch + x * pixel_size;
+
+      SimpleImage* image = new SimpleImage(
+        width, height, format, pixels,
+        (byte*)parent->getPalette(),
+        parent->getPaletteSize(),
+        parent->getPaletteFormat());
+      image->setPitch(pitch);
+      image->setDeleter(0, 0);  // the parent owns everything
+      return image;
     }
 
     ///////////////////////////////////////////////////////////////////////////
@@ -177,31 +276,76 @@ namespace corona {
       const int height = source->getHeight();
       const PixelFormat source_format = source->getFormat();
 
+      // planar images can only be copied
+      if (IsPlanar(source_format)) {
+        if (format != PF_DONTCARE && format != source_format) {
+          return 0;
+        }
+        const int size = GetPlaneOffset(source_format, width, height, 3);
+        byte* pixels = AllocateBuffer(size);
+        if (!pixels) {
+          return 0;
+        }
+        memcpy(pixels, source->getPixels(), size);
+        return new SimpleImage(width, height, source_format, pixels);
+      }
+
       const int source_pixel_size = GetPixelSize(source_format);
       if (source_pixel_size == 0) {
         // unknown pixel size?
         return 0;
       }
 
-      // duplicate the image
-      int image_size = width * height * source_pixel_size;
-      byte* pixels = new byte[image_size];
-      memcpy(pixels, source->getPixels(), image_size);
-      
+      if (IsPalettized(source_format) && IsDirect(format)) {
+        // expand straight out of the source
+        byte* pixels = ExpandPalette(source, format);
+        return (pixels ? new SimpleImage(width, height, format, pixels) : 0);
+      }
+
       if (IsPalettized(source_format)) {
-        // clone palette
+        const int row_size = width * source_pixel_size;
+        auto_buffer<byte> pixels(row_size * height);
+
         int palette_size = source->getPaletteSize();
         PixelFormat palette_format = source->getPaletteFormat();
         int palette_bytes = palette_size * GetPixelSize(palette_format);
-        byte* palette = new byte[palette_bytes];
+        auto_buffer<byte> palette(palette_bytes);
+
+        if (!pixels || !palette) {
+          return 0;
+        }
+
+        // duplicate the indices
+        CopyRows(pixels, row_size,
+                 (const byte*)source->getPixels(), source->getPitch(),
+                 row_size, height);
+
+        // clone palette
         memcpy(palette, source->getPalette(), palette_bytes);
-        Image* image = new SimpleImage(width, height, source_format, pixels,
-                                       palette, palette_size, palette_format);
+        Image* image = new SimpleImage(width, height, source_format,
+                                       pixels.release(), palette.release(),
+                                       palette_size, palette_format);
         return ConvertImage(image, format);
       }
 
-      Image* image = new SimpleImage(width, height, source_format, pixels);
-      return ConvertImage(image, format);
+      // convert straight out of the source, so cloning to another
+      // format is a single pass over the pixels
+      const PixelFormat target_format =
+        (format == PF_DONTCARE ? source_format : format);
+      if (!GetConverter(target_format, source_format)) {
+        return 0;
+      }
+
+      const int target_size = GetPixelSize(target_format);
+      byte* pixels = AllocateBuffer(width * height * target_size);
+      if (!pixels) {
+        return 0;
+      }
+      ConvertRows(pixels, target_format, width * target_size,
+                  (const byte*)source->getPixels(), source_format,
+                  source->getPitch(),
+                  width, height);
+      return new SimpleImage(width, height, target_format, pixels);
     }
 
     ///////////////////////////////////////////////////////////////////////////
@@ -220,23 +364,121 @@ namespace corona {
 
     ///////////////////////////////////////////////////////////////////////////
 
+    COR_EXPORT(Image*) CorOpenImageWithOptions(
+      const char* filename,
+      FileFormat file_format,
+      const OpenOptions* options)
+    {
+      if (!filename) {
+        return 0;
+      }
+
+      std::auto_ptr<File> file(OpenFile(filename, false));
+      return CorOpenImageFromFileWithOptions(file.get(), file_format, options);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Guesses a file's format from its first few bytes, so autodetection
+     * can go straight to the right loader.  Returns FF_AUTODETECT if
+     * the file has no recognizable signature.  Leaves the file at the
+     * beginning.
+     */
+    FileFormat SniffFormat(File* file) {
+      static const byte png_sig[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+      // long enough for a TGA header, the longest fixed prefix we check
+      byte header[18];
+      file->seek(0, File::BEGIN);
+      const int size = file->read(header, 18);
+      file->seek(0, File::BEGIN);
+
+      if (size >= 8 && memcmp(header, png_sig, 8) == 0) {
+        return FF_PNG;
+      }
+      if (size >= 3 &&
+          header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF) {
+        return FF_JPEG;
+      }
+      if (size >= 4 && memcmp(header, "GIF8", 4) == 0) {
+        return FF_GIF;
+      }
+      if (size >= 2 && header[0] == 'B' && header[1] == 'M') {
+        return FF_BMP;
+      }
+      if (size < 18) {
+        return FF_AUTODETECT;
+      }
+
+      // PCX: manufacturer byte, a known version, RLE, 1-8 bits per pixel
+      if (header[0] == 10 && header[1] <= 5 && header[2] == 1 &&
+          (header[3] == 1 || header[3] == 2 ||
+           header[3] == 4 || header[3] == 8)) {
+        return FF_PCX;
+      }
+
+      // TGA has no signature, but the loader only reads true-color
+      // images with an optional color map
+      if (header[1] <= 1 &&
+          (header[2] == 2 || header[2] == 10) &&
+          (header[16] == 24 || header[16] == 32)) {
+        return FF_TGA;
+      }
+
+      return FF_AUTODETECT;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
     COR_EXPORT(Image*) CorOpenImageFromFile(
       File* file,
       FileFormat file_format)
+    {
+      return CorOpenImageFromFileWithOptions(file, file_format, 0);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    COR_EXPORT(Image*) CorOpenImageFromFileWithOptions(
+      File* file,
+      FileFormat file_format,
+      const OpenOptions* options)
     {
       if (!file) {
         return 0;
       }
 
-#define TRY_TYPE(type)                                 \
-  {                                                    \
-    Image* image = CorOpenImageFromFile(file, (type)); \
-    if (image) { return image; }                       \
+      const OpenOptions defaults;
+      if (!options) {
+        options = &defaults;
+      }
+
+      // libjpeg can only scale by these in the DCT
+      const int denominator = options->jpeg_scale_denominator;
+      if ((denominator != 1 && denominator != 2 &&
+           denominator != 4 && denominator != 8) ||
+          options->jpeg_min_width < 0 ||
+          options->jpeg_min_height < 0) {
+        return 0;
+      }
+
+#define TRY_TYPE(type)                                           \
+  {                                                              \
+    Image* image =                                               \
+      CorOpenImageFromFileWithOptions(file, (type), options);    \
+    if (image) { return image; }                                 \
   }
 
       file->seek(0, File::BEGIN);
       switch (file_format) {
         case FF_AUTODETECT: {
+          const FileFormat sniffed = SniffFormat(file);
+          if (sniffed != FF_AUTODETECT) {
+            return CorOpenImageFromFileWithOptions(file, sniffed, options);
+          }
+
+          // no signature: try every loader
 #ifndef NO_PNG
           TRY_TYPE(FF_PNG);
 #endif
@@ -254,7 +496,7 @@ namespace corona {
         case FF_PNG:  return OpenPNG(file);
 #endif
 #ifndef NO_JPEG
-        case FF_JPEG: return OpenJPEG(file);
+        case FF_JPEG: return OpenJPEG(file, 0, options);
 #endif
         case FF_PCX:  return OpenPCX(file);
         case FF_BMP:  return OpenBMP(file);
@@ -266,6 +508,160 @@ namespace corona {
 
     ///////////////////////////////////////////////////////////////////////////
 
+    COR_EXPORT(bool) CorOpenImageInto(
+      const char* filename,
+      FileFormat file_format,
+      Image* target)
+    {
+      if (!filename) {
+        return false;
+      }
+
+      std::auto_ptr<File> file(OpenFile(filename, false));
+      return CorOpenImageIntoFromFile(file.get(), file_format, target);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    COR_EXPORT(bool) CorOpenImageIntoFromFile(
+      File* file,
+      FileFormat file_format,
+      Image* target)
+    {
+      if (!file || !target) {
+        return false;
+      }
+
+#define TRY_TYPE_INTO(type)                                  \
+  {                                                          \
+    if (CorOpenImageIntoFromFile(file, (type), target)) {    \
+      return true;                                           \
+    }                                                        \
+  }
+
+      file->seek(0, File::BEGIN);
+      switch (file_format) {
+        case FF_AUTODETECT: {
+          const FileFormat sniffed = SniffFormat(file);
+          if (sniffed != FF_AUTODETECT) {
+            return CorOpenImageIntoFromFile(file, sniffed, target);
+          }
+
+          // no signature: try every loader
+#ifndef NO_PNG
+          TRY_TYPE_INTO(FF_PNG);
+#endif
+#ifndef NO_JPEG
+          TRY_TYPE_INTO(FF_JPEG);
+#endif
+          TRY_TYPE_INTO(FF_PCX);
+          TRY_TYPE_INTO(FF_BMP);
+          TRY_TYPE_INTO(FF_TGA);
+          TRY_TYPE_INTO(FF_GIF);
+          return false;
+        }
+
+#ifndef NO_PNG
+        case FF_PNG:  return OpenPNG(file, target) != 0;
+#endif
+#ifndef NO_JPEG
+        case FF_JPEG: return OpenJPEG(file, target) != 0;
+#endif
+
+        // the rest decode in their own format and convert from there
+        default: {
+          std::auto_ptr<Image> image(
+            CorOpenImageFromFile(file, file_format));
+          return image.get() && ConvertInto(target, image.get());
+        }
+      }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    COR_EXPORT(bool) CorGetImageInfo(
+      const char* filename,
+      FileFormat file_format,
+      ImageInfo* info)
+    {
+      if (!filename) {
+        return false;
+      }
+
+      std::auto_ptr<File> file(OpenFile(filename, false));
+      return CorGetImageInfoFromFile(file.get(), file_format, info);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    bool Probe(File* file, FileFormat file_format, ImageInfo& info) {
+      switch (file_format) {
+#ifndef NO_PNG
+        case FF_PNG:  return ProbePNG(file, info);
+#endif
+#ifndef NO_JPEG
+        case FF_JPEG: return ProbeJPEG(file, info);
+#endif
+        case FF_PCX:  return ProbePCX(file, info);
+        case FF_BMP:  return ProbeBMP(file, info);
+        case FF_TGA:  return ProbeTGA(file, info);
+        case FF_GIF:  return ProbeGIF(file, info);
+        default:      return false;
+      }
+    }
+
+    COR_EXPORT(bool) CorGetImageInfoFromFile(
+      File* file,
+      FileFormat file_format,
+      ImageInfo* info)
+    {
+      if (!file || !info) {
+        return false;
+      }
+
+#define TRY_TYPE_INFO(type)                                  \
+  {                                                          \
+    if (CorGetImageInfoFromFile(file, (type), info)) {       \
+      return true;                                           \
+    }                                                        \
+  }
+
+      if (file_format == FF_AUTODETECT) {
+        const FileFormat sniffed = SniffFormat(file);
+        if (sniffed != FF_AUTODETECT) {
+          return CorGetImageInfoFromFile(file, sniffed, info);
+        }
+
+        // no signature: try every probe
+#ifndef NO_PNG
+        TRY_TYPE_INFO(FF_PNG);
+#endif
+#ifndef NO_JPEG
+        TRY_TYPE_INFO(FF_JPEG);
+#endif
+        TRY_TYPE_INFO(FF_PCX);
+        TRY_TYPE_INFO(FF_BMP);
+        TRY_TYPE_INFO(FF_TGA);
+        TRY_TYPE_INFO(FF_GIF);
+        return false;
+      }
+
+      ImageInfo probed;
+      probed.palette_size   = 0;
+      probed.palette_format = PF_DONTCARE;
+      probed.file_format    = file_format;
+
+      file->seek(0, File::BEGIN);
+      if (!Probe(file, file_format, probed) ||
+          probed.width <= 0 || probed.height <= 0) {
+        return false;
+      }
+      *info = probed;
+      return true;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
     int strcmp_ci(const char* a, const char* b) {
       while (*a && *b) {
         const int diff = tolower(*a) - tolower(*b);
@@ -289,6 +685,27 @@ namespace corona {
       const char* filename,
       FileFormat file_format,
       Image* image)
+    {
+      return CorSaveImageWithOptions(filename, file_format, image, 0);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    COR_EXPORT(bool) CorSaveImageToFile(
+      File* file,
+      FileFormat file_format,
+      Image* image)
+    {
+      return CorSaveImageToFileWithOptions(file, file_format, image, 0);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    COR_EXPORT(bool) CorSaveImageWithOptions(
+      const char* filename,
+      FileFormat file_format,
+      Image* image,
+      const SaveOptions* options)
     {
       if (!filename) {
         return false;
@@ -307,26 +724,33 @@ namespace corona {
       }
 
       std::auto_ptr<File> file(OpenFile(filename, true));
-      return CorSaveImageToFile(file.get(), file_format, image);
+      return CorSaveImageToFileWithOptions(
+        file.get(), file_format, image, options);
     }
 
     ///////////////////////////////////////////////////////////////////////////
 
-    COR_EXPORT(bool) CorSaveImageToFile(
+    COR_EXPORT(bool) CorSaveImageToFileWithOptions(
       File* file,
       FileFormat file_format,
-      Image* image)
+      Image* image,
+      const SaveOptions* options)
     {
       if (!file || !image) {
         return false;
       }
 
+      const SaveOptions defaults;
+      if (!options) {
+        options = &defaults;
+      }
+
       switch (file_format) {
 #ifndef NO_PNG
-        case FF_PNG:  return SavePNG(file, image);
+        case FF_PNG:  return SavePNG(file, image, *options);
 #endif
 #ifndef NO_JPEG
-        case FF_JPEG: return SaveJPEG(file, image);
+        case FF_JPEG: return SaveJPEG(file, image, *options);
 #endif
         case FF_PCX:  return false;
         case FF_BMP:  return false;
@@ -345,6 +769,8 @@ namespace corona {
         case PF_B8G8R8A8: return 4;
         case PF_B8G8R8:   return 3;
         case PF_I8:       return 1;
+        case PF_L8:       return 1;
+        case PF_L8A8:     return 2;
         default:          return 0;
       }
     }
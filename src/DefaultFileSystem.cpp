@@ -1,4 +1,15 @@
 #include <stdio.h>
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX  // keep std::min usable
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+#include "MemoryFile.h"
 #include "Utility.h"
 
 
@@ -41,9 +52,104 @@ namespace corona {
     FILE* m_file;
   };
 
+  /**
+   * A read-only file mapped into memory.  getContents() hands loaders
+   * the mapping itself.
+   */
+  class MappedFile : public ReadOnlyMemoryFile {
+  public:
+    /// Returns 0 if the file can't be mapped.
+    static MappedFile* open(const char* filename);
+
+    ~MappedFile();
+
+  private:
+    MappedFile(const byte* data, int size)
+    : ReadOnlyMemoryFile(data, size)
+    {
+    }
+  };
+
+#ifdef _WIN32
+
+  MappedFile* MappedFile::open(const char* filename) {
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+      return 0;
+    }
+
+    // empty and huge files aren't worth mapping
+    DWORD high;
+    DWORD size = GetFileSize(file, &high);
+    if (size == 0xFFFFFFFF || size == 0 || high != 0 ||
+        size > 0x7FFFFFFF) {
+      CloseHandle(file);
+      return 0;
+    }
+
+    // the view keeps the mapping alive after the handles are closed
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) {
+      return 0;
+    }
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data) {
+      return 0;
+    }
+
+    return new MappedFile((const byte*)data, int(size));
+  }
+
+  MappedFile::~MappedFile() {
+    UnmapViewOfFile(m_buffer);
+  }
+
+#else
+
+  MappedFile* MappedFile::open(const char* filename) {
+    int fd = ::open(filename, O_RDONLY);
+    if (fd == -1) {
+      return 0;
+    }
+
+    // empty and huge files aren't worth mapping
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ||
+        info.st_size == 0 || info.st_size > 0x7FFFFFFF) {
+      close(fd);
+      return 0;
+    }
+
+    // the mapping outlives the descriptor
+    void* data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      return 0;
+    }
+
+    return new MappedFile((const byte*)data, int(info.st_size));
+  }
+
+  MappedFile::~MappedFile() {
+    munmap((void*)m_buffer, m_size);
+  }
+
+#endif
+
   namespace hidden {
 
     COR_EXPORT(File*) CorOpenFile(const char* filename, bool writeable) {
+      // fall back to stdio if the file can't be mapped
+      if (!writeable) {
+        MappedFile* mapped = MappedFile::open(filename);
+        if (mapped) {
+          return mapped;
+        }
+      }
+
       FILE* file = fopen(filename, (writeable ? "wb" : "rb"));
       return (file ? new CFile(file) : 0);
     }
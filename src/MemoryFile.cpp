@@ -16,6 +16,20 @@ namespace corona {
 
       return new MemoryFile(buffer, size);
     }
+
+    COR_EXPORT(File*) CorCreateReadOnlyMemoryFile(
+      const void* buffer,
+      int size)
+    {
+      if (size && !buffer) {
+        return 0;
+      }
+      if (size < 0) {
+        return 0;
+      }
+
+      return new ReadOnlyMemoryFile(buffer, size);
+    }
     
   }
 
@@ -77,6 +91,11 @@ namespace corona {
     return m_position;
   }
 
+  const void* COR_CALL MemoryFile::getContents(int* size) {
+    *size = m_size;
+    return m_buffer;
+  }
+
   void MemoryFile::ensureSize(int min_size) {
     bool realloc_needed = false;
     while (m_capacity < min_size) {
@@ -94,4 +113,51 @@ namespace corona {
     m_size = min_size;
   }
 
+
+  ReadOnlyMemoryFile::ReadOnlyMemoryFile(const void* buffer, int size) {
+    m_buffer   = (const byte*)buffer;
+    m_size     = size;
+    m_position = 0;
+  }
+
+  int COR_CALL ReadOnlyMemoryFile::read(void* buffer, int size) {
+    int real_read = std::min((m_size - m_position), size);
+    memcpy(buffer, m_buffer + m_position, real_read);
+    m_position += real_read;
+    return real_read;
+  }
+
+  int COR_CALL ReadOnlyMemoryFile::write(const void* /*buffer*/,
+                                         int /*size*/) {
+    return 0;
+  }
+
+  bool COR_CALL ReadOnlyMemoryFile::seek(int position, SeekMode mode) {
+    int real_pos;
+    switch (mode) {
+      case BEGIN:   real_pos = position;              break;
+      case CURRENT: real_pos = m_position + position; break;
+      case END:     real_pos = m_size + position;     break;
+      default:      return false;
+    }
+
+    // same as MemoryFile
+    if (real_pos < 0 || real_pos > m_size) {
+      m_position = 0;
+      return false;
+    } else {
+      m_position = real_pos;
+      return true;
+    }
+  }
+
+  int COR_CALL ReadOnlyMemoryFile::tell() {
+    return m_position;
+  }
+
+  const void* COR_CALL ReadOnlyMemoryFile::getContents(int* size) {
+    *size = m_size;
+    return m_buffer;
+  }
+
 };
@@ -9,6 +9,7 @@
 
 namespace corona {
 
+  /// A growable file that starts out with a copy of a buffer.
   class MemoryFile : public DLLImplementation<File> {
   public:
     MemoryFile(const void* buffer, int size);
@@ -18,6 +19,7 @@ namespace corona {
     int  COR_CALL write(const void* buffer, int size);
     bool COR_CALL seek(int position, SeekMode mode);
     int  COR_CALL tell();
+    const void* COR_CALL getContents(int* size);
 
   private:
     void ensureSize(int min_size);
@@ -30,6 +32,27 @@ namespace corona {
     int m_capacity;
   };
 
+
+  /**
+   * A file that reads a buffer it doesn't own in place.  It can't be
+   * written to.
+   */
+  class ReadOnlyMemoryFile : public DLLImplementation<File> {
+  public:
+    ReadOnlyMemoryFile(const void* buffer, int size);
+
+    int  COR_CALL read(void* buffer, int size);
+    int  COR_CALL write(const void* buffer, int size);
+    bool COR_CALL seek(int position, SeekMode mode);
+    int  COR_CALL tell();
+    const void* COR_CALL getContents(int* size);
+
+  protected:
+    const byte* m_buffer;
+    int m_size;
+    int m_position;
+  };
+
 }
 
 
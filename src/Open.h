@@ -6,16 +6,40 @@
 
 
 namespace corona {
+  /*
+   * The PNG and JPEG loaders can also decode straight into a direct
+   * color target image of the right size.  Given one, they return it
+   * on success, and 0 if the file can't be decoded or doesn't fit.
+   */
+
   Image* OpenBMP (File* file); // OpenBMP.cpp
 #ifndef NO_JPEG
-  Image* OpenJPEG(File* file); // OpenJPEG.cpp
+  Image* OpenJPEG(File* file, Image* target = 0,
+                  const OpenOptions* options = 0); // OpenJPEG.cpp
 #endif
   Image* OpenPCX (File* file); // OpenPCX.cpp
 #ifndef NO_PNG
-  Image* OpenPNG (File* file); // OpenPNG.cpp
+  Image* OpenPNG (File* file, Image* target = 0); // OpenPNG.cpp
 #endif
   Image* OpenTGA (File* file); // OpenTGA.cpp
   Image* OpenGIF (File* file); // OpenGIF.cpp
+
+  /*
+   * The probes read as little of the file as they can to fill in the
+   * dimensions and formats of an ImageInfo.  The caller initializes
+   * the palette fields for direct color images and the file format.
+   */
+
+  bool ProbeBMP (File* file, ImageInfo& info); // OpenBMP.cpp
+#ifndef NO_JPEG
+  bool ProbeJPEG(File* file, ImageInfo& info); // OpenJPEG.cpp
+#endif
+  bool ProbePCX (File* file, ImageInfo& info); // OpenPCX.cpp
+#ifndef NO_PNG
+  bool ProbePNG (File* file, ImageInfo& info); // OpenPNG.cpp
+#endif
+  bool ProbeTGA (File* file, ImageInfo& info); // OpenTGA.cpp
+  bool ProbeGIF (File* file, ImageInfo& info); // OpenGIF.cpp
 }
 
 
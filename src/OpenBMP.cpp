@@ -8,6 +8,9 @@
 
 #include <string.h>
 #include "corona.h"
+#include "Allocator.h"
+#include "BufferedFile.h"
+#include "Convert.h"
 #include "SimpleImage.h"
 #include "Utility.h"
 
@@ -43,8 +46,15 @@ namespace corona {
   bool   ReadPalette(File* file, Header& h);
   Image* DecodeBitmap(File* file, const Header& h);
 
+  typedef Image* (*Decoder)(const byte* raster_data, const Header& h);
+  Decoder ChooseDecoder(const Header& h);
+
   
-  Image* OpenBMP(File* file) {
+  Image* OpenBMP(File* unbuffered) {
+    // the headers and palette are read in small pieces
+    BufferedFile buffered(unbuffered);
+    File* file = &buffered;
+
     Header h;
     if (ReadHeader(file, h) &&
         ReadInfoHeader(file, h) &&
@@ -60,6 +70,30 @@ namespace corona {
   }
 
 
+  bool ProbeBMP(File* file, ImageInfo& info) {
+    // the palette comes right after the info header, so don't read it
+    Header h;
+    if (!ReadHeader(file, h) ||
+        !ReadInfoHeader(file, h) ||
+        !ChooseDecoder(h)) {
+      return false;
+    }
+
+    info.width  = h.width;
+    info.height = h.height;
+    if (h.bpp <= 8) {
+      info.format         = PF_I8;
+      info.palette_size   = 256;
+      info.palette_format = PF_B8G8R8;
+    } else if (h.bpp == 24) {
+      info.format = PF_B8G8R8;
+    } else {
+      info.format = PF_R8G8B8;
+    }
+    return true;
+  }
+
+
   bool ReadHeader(File* file, Header& h) {
     byte header[14];
     if (file->read(header, 14) != 14) {
@@ -250,17 +284,10 @@ namespace corona {
       return false;
     }
 
-    byte* in = buffer;
-    BGR* out = h.palette;
-    for (int i = 0; i < h.palette_size; ++i) {
-      out->blue  = *in++;
-      out->green = *in++;
-      out->red   = *in++;
-      if (!h.os2) {
-        ++in;  // skip alpha
-      }
-      ++out;
-    }
+    // OS/2 entries are BGR, Windows entries are BGR plus an unused byte
+    ConvertPixels((byte*)h.palette.get(), PF_B8G8R8,
+                  buffer, (h.os2 ? PF_B8G8R8 : PF_B8G8R8A8),
+                  h.palette_size);
 
     return true;
   }
@@ -277,9 +304,12 @@ namespace corona {
   }
 
   Image* ReadBitmap1(const byte* raster_data, const Header& h) {
-    auto_array<byte> pixels(new byte[h.width * h.height]);
-    
-    auto_array<BGR> palette(new BGR[256]);
+    auto_buffer<byte> pixels(h.width * h.height);
+    auto_buffer<BGR> palette(256 * sizeof(BGR));
+    if (!pixels || !palette) {
+      return 0;
+    }
+
     memset(palette, 0, 256 * sizeof(BGR));
     memcpy(palette, h.palette, h.palette_size * sizeof(BGR));
 
@@ -304,9 +334,12 @@ namespace corona {
   }
 
   Image* ReadBitmap4(const byte* raster_data, const Header& h) {
-    auto_array<byte> pixels(new byte[h.width * h.height]);
-    
-    auto_array<BGR> palette(new BGR[256]);
+    auto_buffer<byte> pixels(h.width * h.height);
+    auto_buffer<BGR> palette(256 * sizeof(BGR));
+    if (!pixels || !palette) {
+      return 0;
+    }
+
     memset(palette, 0, 256 * sizeof(BGR));
     memcpy(palette, h.palette, h.palette_size * sizeof(BGR));
 
@@ -331,9 +364,12 @@ namespace corona {
   }
 
   Image* ReadBitmapRLE4(const byte* raster_data, const Header& h) {
-    auto_array<byte> pixels(new byte[h.width * h.height]);
-    
-    auto_array<BGR> palette(new BGR[256]);
+    auto_buffer<byte> pixels(h.width * h.height);
+    auto_buffer<BGR> palette(256 * sizeof(BGR));
+    if (!pixels || !palette) {
+      return 0;
+    }
+
     memset(palette, 0, 256 * sizeof(BGR));
     memcpy(palette, h.palette, h.palette_size * sizeof(BGR));
 
@@ -451,9 +487,12 @@ namespace corona {
   }
 
   Image* ReadBitmap8(const byte* raster_data, const Header& h) {
-    auto_array<byte> pixels(new byte[h.width * h.height]);
-    
-    auto_array<BGR> palette(new BGR[256]);
+    auto_buffer<byte> pixels(h.width * h.height);
+    auto_buffer<BGR> palette(256 * sizeof(BGR));
+    if (!pixels || !palette) {
+      return 0;
+    }
+
     memset(palette, 0, 256 * sizeof(BGR));
     memcpy(palette, h.palette, h.palette_size * sizeof(BGR));
 
@@ -471,9 +510,12 @@ namespace corona {
   }
 
   Image* ReadBitmapRLE8(const byte* raster_data, const Header& h) {
-    auto_array<byte> pixels(new byte[h.width * h.height]);
-    
-    auto_array<BGR> palette(new BGR[256]);
+    auto_buffer<byte> pixels(h.width * h.height);
+    auto_buffer<BGR> palette(256 * sizeof(BGR));
+    if (!pixels || !palette) {
+      return 0;
+    }
+
     memset(palette, 0, 256 * sizeof(BGR));
     memcpy(palette, h.palette, h.palette_size * sizeof(BGR));
 
@@ -572,7 +614,10 @@ namespace corona {
   }
   
   Image* ReadBitmap16(const byte* raster_data, const Header& h) {
-    auto_array<RGB> pixels(new RGB[h.width * h.height]);
+    auto_buffer<RGB> pixels(h.width * h.height * sizeof(RGB));
+    if (!pixels) {
+      return 0;
+    }
 
     for (int i = 0; i < h.height; ++i) {
       const byte* in = raster_data + i * h.pitch;
@@ -598,7 +643,10 @@ namespace corona {
   }
 
   Image* ReadBitmap24(const byte* raster_data, const Header& h) {
-    auto_array<BGR> pixels(new BGR[h.width * h.height]);
+    auto_buffer<BGR> pixels(h.width * h.height * sizeof(BGR));
+    if (!pixels) {
+      return 0;
+    }
 
     for (int i = 0; i < h.height; ++i) {
       const byte* in = raster_data + i * h.pitch;
@@ -617,7 +665,10 @@ namespace corona {
   }
 
   Image* ReadBitmap32(const byte* raster_data, const Header& h) {
-    auto_array<RGB> pixels(new RGB[h.width * h.height]);
+    auto_buffer<RGB> pixels(h.width * h.height * sizeof(RGB));
+    if (!pixels) {
+      return 0;
+    }
 
     for (int i = 0; i < h.height; ++i) {
       const byte* in = raster_data + i * h.pitch;
@@ -639,21 +690,42 @@ namespace corona {
 
   Image* DecodeBitmap(File* file, const Header& h) {
 
-    if (!file->seek(h.data_offset, File::BEGIN)) {
+    Decoder decoder = ChooseDecoder(h);
+    if (!decoder) {
       return 0;
     }
 
-    // the raster data stored in the file
-    auto_array<byte> raster_data(new byte[h.image_size]);
-    if (file->read(raster_data, h.image_size) != h.image_size) {
-      return 0;
+    // the raster data stored in the file: decode it in place if the
+    // file is in memory, otherwise read it
+    auto_array<byte> raster_copy;
+    const byte* raster_data;
+    int file_size;
+    const byte* contents = (const byte*)file->getContents(&file_size);
+    if (contents &&
+        h.data_offset >= 0 && h.data_offset <= file_size &&
+        h.image_size >= 0 && h.image_size <= file_size - h.data_offset) {
+
+      raster_data = contents + h.data_offset;
+
+    } else {
+
+      if (!file->seek(h.data_offset, File::BEGIN)) {
+        return 0;
+      }
+
+      raster_copy = new byte[h.image_size];
+      if (file->read(raster_copy, h.image_size) != h.image_size) {
+        return 0;
+      }
+      raster_data = raster_copy;
+
     }
 
-    // the output pixel buffer (parameter to new SimpleImage)
-    auto_array<byte> pixels(new byte[h.width * h.height * 3]);
+    return decoder(raster_data, h);
+  }
 
-    typedef Image* (*Decoder)(const byte* raster_data, const Header& h);
 
+  Decoder ChooseDecoder(const Header& h) {
     Decoder decoder = 0;
 
     if      (h.bpp == 1  &&  h.compression == 0)  { decoder = ReadBitmap1;    }
@@ -666,12 +738,7 @@ namespace corona {
     else if (h.bpp == 24 &&  h.compression == 0)  { decoder = ReadBitmap24;   }
     else if (h.bpp == 32 && (h.compression == 0 ||
                              h.compression == 3)) { decoder = ReadBitmap32;   }
-
-    if (decoder) {
-      return decoder(raster_data.get(), h);
-    } else {
-      return 0;
-    }
+    return decoder;
   }
 
 }
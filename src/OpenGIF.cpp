@@ -3,6 +3,9 @@
 extern "C" {
   #include <gif_lib.h>
 }
+#include "Allocator.h"
+#include "BufferedFile.h"
+#include "Convert.h"
 #include "Debug.h"
 #include "Open.h"
 #include "SimpleImage.h"
@@ -19,8 +22,11 @@ namespace corona {
   Image* OpenGIF(File* file) {
     COR_GUARD("OpenGIF");
 
+    // libungif reads the LZW data in blocks of at most 255 bytes
+    BufferedFile buffered(file);
+
     // open GIF file
-    GifFileType* gif = DGifOpen(file, InputFunc);
+    GifFileType* gif = DGifOpen(&buffered, InputFunc);
     if (!gif) {
       COR_LOG("DGifOpen failed");
       return 0;
@@ -59,8 +65,12 @@ namespace corona {
 
     const int width = gif->SWidth;
     const int height = gif->SHeight;
-    auto_array<byte> image(new byte[width * height]);
-    auto_array<RGBA> palette(new RGBA[256]);
+    auto_buffer<byte> image(width * height);
+    auto_buffer<RGBA> palette(256 * sizeof(RGBA));
+    if (!image || !palette) {
+      DGifCloseFile(gif);
+      return 0;
+    }
 
     // look for the transparent color extension
     int transparent = -1;
@@ -77,11 +87,10 @@ namespace corona {
 
     // copy over the palette
     memset(palette, 0, 256 * 4);
-    for (int i = 0; i < cmap->ColorCount; ++i) {
-      palette[i].red   = cmap->Colors[i].Red;
-      palette[i].green = cmap->Colors[i].Green;
-      palette[i].blue  = cmap->Colors[i].Blue;
-      palette[i].alpha = (transparent == i ? 0 : 255);
+    ConvertPixels((byte*)palette.get(), PF_R8G8B8A8,
+                  (byte*)cmap->Colors, PF_R8G8B8, cmap->ColorCount);
+    if (transparent >= 0 && transparent < cmap->ColorCount) {
+      palette[transparent].alpha = 0;
     }
 
     byte* in = (byte*)gif_image->RasterBits;
@@ -134,4 +143,26 @@ namespace corona {
                            (byte*)palette.release(), 256, PF_R8G8B8A8);
   }
 
+  bool ProbeGIF(File* file, ImageInfo& info) {
+    COR_GUARD("ProbeGIF");
+
+    // signature and logical screen descriptor
+    byte header[13];
+    if (file->read(header, 13) != 13 || memcmp(header, "GIF", 3) != 0) {
+      return false;
+    }
+
+    // OpenGIF needs a global color map
+    if ((header[10] & 0x80) == 0) {
+      return false;
+    }
+
+    info.width          = read16_le(header + 6);
+    info.height         = read16_le(header + 8);
+    info.format         = PF_I8;
+    info.palette_size   = 256;
+    info.palette_format = PF_R8G8B8A8;
+    return true;
+  }
+
 }
@@ -1,9 +1,12 @@
 #include <stdio.h>  // needed by jpeglib.h
 #include <string.h>
+#include <algorithm>
 #include <setjmp.h>
 extern "C" {  // stupid JPEG library
   #include <jpeglib.h>
 }
+#include "Allocator.h"
+#include "Convert.h"
 #include "Open.h"
 #include "SimpleImage.h"
 
@@ -12,6 +15,10 @@ namespace corona {
 
   static const int JPEG_BUFFER_SIZE = 4096;
 
+  // libjpeg returns at most an iMCU row of scanlines per call, which
+  // is 16 rows at the most common sampling factors
+  static const int JPEG_ROWS_PER_READ = 16;
+
 
   void    JPEG_init_source(j_decompress_ptr cinfo);
   boolean JPEG_fill_input_buffer(j_decompress_ptr cinfo);
@@ -33,14 +40,207 @@ namespace corona {
 
   //////////////////////////////////////////////////////////////////////////////
 
-  Image* OpenJPEG(File* file) {
+  /**
+   * Spreads the width greyscale samples at the end of an RGB row over
+   * the whole row, in place.  Going forward, each write lands at or
+   * before the sample being read, so nothing is overwritten early.
+   */
+  void SpreadGrey(byte* row, int width) {
+    const byte* in = row + width * 2;
+    for (int i = 0; i < width; ++i) {
+      const byte v = in[i];
+      row[i * 3 + 0] = v;
+      row[i * 3 + 1] = v;
+      row[i * 3 + 2] = v;
+    }
+  }
+
+  /**
+   * Reads the scanlines of a started decompression straight into
+   * target, converting them to its format.  Several rows are read per
+   * call.  Targets in the decoder's own format, PF_R8G8B8 or PF_L8,
+   * are decoded in place, as are greyscale images into RGB targets:
+   * their samples go into the end of each row and are spread out from
+   * there.  Other targets go through a batch of scratch rows.  If the
+   * data ends early, the rest of the target is filled with black.
+   */
+  bool DecodeScanlinesInto(Image* target, jpeg_decompress_struct& cinfo) {
+    const int width  = cinfo.output_width;
+    const int height = cinfo.output_height;
+    if (!CanDecodeInto(target, width, height)) {
+      return false;
+    }
+
+    const PixelFormat format = target->getFormat();
+    const int components = cinfo.output_components;
+    const PixelFormat decoded = (components == 1 ? PF_L8 : PF_R8G8B8);
+    const bool spread = (components == 1 && format == PF_R8G8B8);
+    const bool in_place = (format == decoded || spread);
+
+    RowConverter converter;
+    JSAMPARRAY buffer = 0;
+    if (!in_place) {
+      converter.init(format, decoded);
+
+      // goes away with the decompressor
+      buffer = (*cinfo.mem->alloc_sarray)(
+        (j_common_ptr)&cinfo, JPOOL_IMAGE,
+        width * components, JPEG_ROWS_PER_READ);
+    }
+
+    byte* out = (byte*)target->getPixels();
+    const int pitch = target->getPitch();
+    const int offset = (spread ? width * 2 : 0);
+    JSAMPROW rows[JPEG_ROWS_PER_READ];
+
+    while (int(cinfo.output_scanline) < height) {
+      const int first = cinfo.output_scanline;
+      const int count = std::min(int(JPEG_ROWS_PER_READ), height - first);
+      if (in_place) {
+        for (int i = 0; i < count; ++i) {
+          rows[i] = out + (first + i) * pitch + offset;
+        }
+      }
+
+      const int read = jpeg_read_scanlines(
+        &cinfo, (in_place ? rows : buffer), count);
+      if (read == 0) {
+        const int row_size = width * GetPixelSize(format);
+        for (int y = first; y < height; ++y) {
+          memset(out + y * pitch, 0, row_size);
+        }
+        break;
+      }
+
+      for (int i = 0; i < read; ++i) {
+        byte* row = out + (first + i) * pitch;
+        if (!in_place) {
+          converter.convert(row, (const byte*)buffer[i], width);
+        } else if (spread) {
+          SpreadGrey(row, width);
+        }
+      }
+    }
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /**
+   * Returns the rows of a component that one jpeg_read_raw_data()
+   * call produces.  (libjpeg 7 split the DCT scaling into horizontal
+   * and vertical sizes.)
+   */
+  int GetRawRows(const jpeg_component_info& component) {
+#if JPEG_LIB_VERSION >= 70
+    return component.v_samp_factor * component.DCT_v_scaled_size;
+#else
+    return component.v_samp_factor * component.DCT_scaled_size;
+#endif
+  }
+
+  /**
+   * Returns the planar format whose planes are the same size as the
+   * components libjpeg will output, or PF_DONTCARE if there isn't one.
+   * The output dimensions must already be calculated.
+   */
+  PixelFormat GetPlanarFormat(jpeg_decompress_struct& cinfo) {
+    if (cinfo.jpeg_color_space != JCS_YCbCr || cinfo.num_components != 3) {
+      return PF_DONTCARE;
+    }
+
+    static const PixelFormat formats[] = {
+      PF_YCbCr444, PF_YCbCr422, PF_YCbCr420,
+    };
+    for (int i = 0; i < 3; ++i) {
+      bool match = true;
+      for (int c = 0; c < 3; ++c) {
+        const jpeg_component_info& component = cinfo.comp_info[c];
+        const int width  = cinfo.output_width;
+        const int height = cinfo.output_height;
+        if (int(component.downsampled_width) !=
+              GetPlaneWidth(formats[i], width, c) ||
+            int(component.downsampled_height) !=
+              GetPlaneHeight(formats[i], height, c))
+        {
+          match = false;
+        }
+      }
+      if (match) {
+        return formats[i];
+      }
+    }
+    return PF_DONTCARE;
+  }
 
+  /**
+   * Reads the raw components of a started decompression into the
+   * planes of image.  libjpeg pads each component out to whole blocks,
+   * so every call's rows land in a scratch buffer and only the part
+   * inside the plane is copied.  If the data ends early, the rest of
+   * the image is filled with black.
+   */
+  void DecodePlanes(Image* image, jpeg_decompress_struct& cinfo) {
+    const PixelFormat format = image->getFormat();
+    const int width  = image->getWidth();
+    const int height = image->getHeight();
+
+    JSAMPARRAY buffers[3];
+    int rows[3];
+    for (int c = 0; c < 3; ++c) {
+      const jpeg_component_info& component = cinfo.comp_info[c];
+      rows[c] = GetRawRows(component);
+
+      // goes away with the decompressor
+      buffers[c] = (*cinfo.mem->alloc_sarray)(
+        (j_common_ptr)&cinfo, JPOOL_IMAGE,
+        component.width_in_blocks * DCTSIZE, rows[c]);
+    }
+
+    // the Y component has the most rows per call
+    int call = 0;
+    for (; int(cinfo.output_scanline) < height; ++call) {
+      if (jpeg_read_raw_data(&cinfo, buffers, rows[0]) == 0) {
+        break;
+      }
+
+      for (int c = 0; c < 3; ++c) {
+        const int plane_width  = GetPlaneWidth(format, width, c);
+        const int plane_height = GetPlaneHeight(format, height, c);
+        byte* plane = (byte*)GetPlane(image, c);
+        const int first = call * rows[c];
+        const int count = std::min(rows[c], plane_height - first);
+        for (int i = 0; i < count; ++i) {
+          memcpy(plane + (first + i) * plane_width, buffers[c][i],
+                 plane_width);
+        }
+      }
+    }
+
+    // black is Y = 0 with neutral chroma
+    for (int c = 0; c < 3; ++c) {
+      const int plane_width  = GetPlaneWidth(format, width, c);
+      const int plane_height = GetPlaneHeight(format, height, c);
+      const int done = std::min(plane_height, call * rows[c]);
+      byte* plane = (byte*)GetPlane(image, c);
+      memset(plane + done * plane_width, (c == 0 ? 0 : 128),
+             (plane_height - done) * plane_width);
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /**
+   * Sets up a decompressor that reads from file through is and mgr.
+   * The caller still has to setjmp() before using it.
+   */
+  void CreateDecompress(jpeg_decompress_struct& cinfo, jpeg_source_mgr& mgr,
+                        InternalStruct& is, File* file)
+  {
     // set up internal information
-    InternalStruct is;
     is.file = file;
 
     // initialize the source manager
-    jpeg_source_mgr mgr;
     mgr.bytes_in_buffer = 0;
     mgr.next_input_byte = NULL;
     mgr.init_source       = JPEG_init_source;
@@ -48,15 +248,63 @@ namespace corona {
     mgr.skip_input_data   = JPEG_skip_input_data;
     mgr.resync_to_restart = jpeg_resync_to_restart;  // use default
     mgr.term_source       = JPEG_term_source;
+
+    // a file that is already in memory is handed to libjpeg in one
+    // piece.  leaving the file at its end makes the next fill insert EOI
+    int size;
+    const byte* contents = (const byte*)file->getContents(&size);
+    if (contents) {
+      const int position = file->tell();
+      mgr.next_input_byte = contents + position;
+      mgr.bytes_in_buffer = size - position;
+      file->seek(0, File::END);
+    }
     
     // initialize decompressor
-    jpeg_decompress_struct cinfo;
     jpeg_create_decompress(&cinfo);
     cinfo.client_data = &is;
 
     cinfo.err = jpeg_std_error(&is.error_mgr.mgr);
     is.error_mgr.mgr.error_exit = JPEG_error_exit;
 
+    cinfo.src = &mgr;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /**
+   * Picks the DCT scaling for a decode.  With a minimum size, that's
+   * the largest reduction that still gives at least that size.
+   * Otherwise it's the requested denominator.
+   */
+  int GetScaleDenominator(jpeg_decompress_struct& cinfo,
+                          const OpenOptions& options)
+  {
+    if (!options.jpeg_min_width && !options.jpeg_min_height) {
+      return options.jpeg_scale_denominator;
+    }
+
+    for (int denominator = 8; denominator > 1; denominator /= 2) {
+      // libjpeg rounds the scaled size up
+      const int width  = (cinfo.image_width  + denominator - 1) / denominator;
+      const int height = (cinfo.image_height + denominator - 1) / denominator;
+      if (width  >= options.jpeg_min_width &&
+          height >= options.jpeg_min_height) {
+        return denominator;
+      }
+    }
+    return 1;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  Image* OpenJPEG(File* file, Image* target, const OpenOptions* options) {
+
+    InternalStruct is;
+    jpeg_source_mgr mgr;
+    jpeg_decompress_struct cinfo;
+    CreateDecompress(cinfo, mgr, is, file);
+
     SimpleImage* image = 0;
     
     if (setjmp(is.error_mgr.setjmp_buffer)) {
@@ -65,8 +313,19 @@ namespace corona {
       return 0;
     }
 
-    cinfo.src = &mgr;
     jpeg_read_header(&cinfo, TRUE);
+    if (options) {
+      cinfo.scale_num   = 1;
+      cinfo.scale_denom = GetScaleDenominator(cinfo, *options);
+    }
+
+    // the component sizes are known once the scaling is
+    PixelFormat planar = PF_DONTCARE;
+    if (options && options->jpeg_ycbcr_planes && !target) {
+      jpeg_calc_output_dimensions(&cinfo);
+      planar = GetPlanarFormat(cinfo);
+      cinfo.raw_data_out = (planar != PF_DONTCARE);
+    }
     jpeg_start_decompress(&cinfo);
 
     // do we support the number of color components?
@@ -76,50 +335,46 @@ namespace corona {
       return 0;
     }
 
-    // make a one-row-high sample array that will go away when done with image
-    int row_stride = cinfo.output_width * cinfo.output_components;
-    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)(
-      (j_common_ptr)&cinfo,
-      JPOOL_IMAGE,
-      row_stride,
-      1);
+    // decoding into the caller's image
+    if (target) {
+      bool result = DecodeScanlinesInto(target, cinfo);
+      if (result && cinfo.output_scanline == cinfo.output_height) {
+        jpeg_finish_decompress(&cinfo);
+      }
+      jpeg_destroy_decompress(&cinfo);
+      return (result ? target : 0);
+    }
 
-    // allocate image
+    // allocate image.  every byte is written by the decoder, so it
+    // doesn't need clearing
     unsigned width  = cinfo.output_width;
     unsigned height = cinfo.output_height;
-    byte* pixels = new byte[width * height * 3];
-    memset(pixels, 0, width * height * 3);
+    const PixelFormat format =
+      (planar != PF_DONTCARE ? planar :
+       cinfo.output_components == 1 ? PF_L8 : PF_R8G8B8);
+    const int size = (planar != PF_DONTCARE ?
+                      GetPlaneOffset(planar, width, height, 3) :
+                      width * height * GetPixelSize(format));
+    byte* pixels = AllocateBuffer(size);
+    if (!pixels) {
+      jpeg_destroy_decompress(&cinfo);
+      return 0;
+    }
 
     // create the image object now, so that if the error handler is called,
     // the longjmp code will know what to free
-    image = new SimpleImage(width, height, PF_R8G8B8, pixels);
-
-    // read the scanlines
-    bool finished = true;
-    while (cinfo.output_scanline < height) {
-      int num_rows = jpeg_read_scanlines(&cinfo, buffer, 1);
-      if (num_rows == 0) {
-        finished = false;
-        break;
-      }
+    image = new SimpleImage(width, height, format, pixels);
 
-      // copy scanline into pixel buffer
-      if (cinfo.output_components == 1) {        // greyscale
-        byte* in = (byte*)(*buffer);
-        for (unsigned i = 0; i < width * num_rows; ++i) {
-          *pixels++ = *in; // red
-          *pixels++ = *in; // green
-          *pixels++ = *in; // blue
-          ++in;
-        }
-      } else if (cinfo.output_components == 3) { // RGB
-        memcpy(pixels, (*buffer), num_rows * width * 3);
-        pixels += num_rows * width * 3;
-      }
+    // read the scanlines, or the raw planes
+    if (planar != PF_DONTCARE) {
+      DecodePlanes(image, cinfo);
+    } else {
+      DecodeScanlinesInto(image, cinfo);
     }
 
-    // finish up
-    if (finished) {
+    // finish up.  raw reads go in whole iMCU rows, so they can run
+    // past the last scanline
+    if (cinfo.output_scanline >= cinfo.output_height) {
       jpeg_finish_decompress(&cinfo);
     }
     jpeg_destroy_decompress(&cinfo);
@@ -129,6 +384,35 @@ namespace corona {
 
   //////////////////////////////////////////////////////////////////////////////
 
+  bool ProbeJPEG(File* file, ImageInfo& info) {
+
+    InternalStruct is;
+    jpeg_source_mgr mgr;
+    jpeg_decompress_struct cinfo;
+    CreateDecompress(cinfo, mgr, is, file);
+
+    if (setjmp(is.error_mgr.setjmp_buffer)) {
+      jpeg_destroy_decompress(&cinfo);
+      return false;
+    }
+
+    // reads up to the start of the first scan, then works out the
+    // output size without starting decompression
+    jpeg_read_header(&cinfo, TRUE);
+    jpeg_calc_output_dimensions(&cinfo);
+
+    const int components = cinfo.output_components;
+    info.width  = cinfo.output_width;
+    info.height = cinfo.output_height;
+    info.format = (components == 1 ? PF_L8 : PF_R8G8B8);
+    jpeg_destroy_decompress(&cinfo);
+
+    // OpenJPEG only handles greyscale and RGB
+    return (components == 1 || components == 3);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
   void JPEG_init_source(j_decompress_ptr cinfo) {
     // no initialization required
   }
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <string.h>
+#include "Allocator.h"
+#include "BufferedFile.h"
 #include "Debug.h"
 #include "Open.h"
 #include "SimpleImage.h"
@@ -34,13 +36,13 @@ namespace corona {
 
   //////////////////////////////////////////////////////////////////////////////
 
-  bool ReadScanline(File* file, int scansize, byte* scanline) {
+  bool ReadScanline(BufferedFile* file, int scansize, byte* scanline) {
     byte* out = scanline;
     while (out - scanline < scansize) {
 
       // read a byte!
       byte data;
-      if (file->read(&data, 1) != 1) {
+      if (!file->readByte(data)) {
         return false;
       }
 
@@ -50,7 +52,7 @@ namespace corona {
 
         // read the repeated byte
         int numbytes = data & 0x3F;
-        if (file->read(&data, 1) != 1) {
+        if (!file->readByte(data)) {
           return false;
         }
 
@@ -66,9 +68,20 @@ namespace corona {
 
   //////////////////////////////////////////////////////////////////////////////
 
+  Image* DecodePCX(BufferedFile* file);
+
   Image* OpenPCX(File* file) {
     COR_GUARD("OpenPCX");
 
+    // the scanlines are RLE-encoded a byte at a time
+    BufferedFile buffered(file);
+    return DecodePCX(&buffered);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  Image* DecodePCX(BufferedFile* file) {
+
     // read the header block
     byte pcx_header[128];
     int read = file->read(pcx_header, 128);
@@ -116,14 +129,16 @@ namespace corona {
     int height = ymax - ymin + 1;
 
     auto_array<byte> scanline(new byte[bytes_per_line]);
-    auto_array<byte> pixels(new byte[width * height * 3]);
 
     // decode the pixel data
 
     if (num_planes == 1) {               // 256 colors
 
-      auto_array<RGB> palette(new RGB[256]);
-      auto_array<byte> image(new byte[width * height]);
+      auto_buffer<RGB> palette(256 * sizeof(RGB));
+      auto_buffer<byte> image(width * height);
+      if (!palette || !image) {
+        return 0;
+      }
 
       // read all of the scanlines
       for (int iy = 0; iy < height; ++iy) {
@@ -159,6 +174,10 @@ namespace corona {
     } else if (num_planes == 3) { // 24-bit color
 
       auto_array<byte> scanline(new byte[3 * bytes_per_line]);
+      auto_buffer<byte> pixels(width * height * 3);
+      if (!pixels) {
+        return 0;
+      }
 
       byte* out = pixels;
       for (int iy = 0; iy < height; ++iy) {
@@ -187,4 +206,41 @@ namespace corona {
 
   //////////////////////////////////////////////////////////////////////////////
 
+  bool ProbePCX(File* file, ImageInfo& info) {
+    COR_GUARD("ProbePCX");
+
+    byte pcx_header[128];
+    if (file->read(pcx_header, 128) != 128) {
+      return false;
+    }
+
+    int encoding   = pcx_header[2];
+    int bpp        = pcx_header[3];
+    int xmin       = read16_le(pcx_header + 4);
+    int ymin       = read16_le(pcx_header + 6);
+    int xmax       = read16_le(pcx_header + 8);
+    int ymax       = read16_le(pcx_header + 10);
+    int num_planes = pcx_header[65];
+
+    // same restrictions as OpenPCX
+    if (encoding != 1 || bpp != 8) {
+      return false;
+    }
+
+    info.width  = xmax - xmin + 1;
+    info.height = ymax - ymin + 1;
+    if (num_planes == 1) {
+      info.format         = PF_I8;
+      info.palette_size   = 256;
+      info.palette_format = PF_R8G8B8;
+    } else if (num_planes == 3) {
+      info.format = PF_R8G8B8;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
 }
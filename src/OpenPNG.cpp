@@ -5,7 +5,10 @@
  */
 
 
+#include <string.h>
 #include <png.h>
+#include "Allocator.h"
+#include "Convert.h"
 #include "Debug.h"
 #include "Open.h"
 #include "SimpleImage.h"
@@ -48,209 +51,295 @@ namespace corona {
 
   //////////////////////////////////////////////////////////////////////////////
 
-  void fill_palette(png_structp png, png_infop info, png_color palette[256]) {
-
-   COR_GUARD("fill_palette");
+  /**
+   * The libpng state and everything allocated while decoding.  It
+   * lives outside the functions that call setjmp(), so it is cleaned
+   * up normally when libpng longjmps out of them.
+   */
+  struct PNGDecoder {
+    PNGDecoder() {
+      png_ptr  = 0;
+      info_ptr = 0;
+    }
 
-    // by default, the palette is greyscale
-    for (int i = 0; i < 256; ++i) {
-      palette[i].red   = i;
-      palette[i].green = i;
-      palette[i].blue  = i;
+    ~PNGDecoder() {
+      if (png_ptr) {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+      }
     }
 
-    // do we have a palette and is it big enough?
-    png_colorp png_palette;
-    int num_palette = 0;
-    png_get_PLTE(png, info, &png_palette, &num_palette);
+    png_structp png_ptr;
+    png_infop   info_ptr;
 
-    COR_IF_DEBUG {
-      char str[80];
-      sprintf(str, "palette size: %d", num_palette);
-      COR_LOG(str);
-    }
+    // filled in by StartPNG
+    int width;
+    int height;
+    int passes;
+    PixelFormat format;  ///< the format of the rows libpng hands back
 
-    if (num_palette >= 256) {
-
-#if 0
-      COR_IF_DEBUG {
-        for (int i = 0; i < 256; ++i) {
-          char str[80];
-          sprintf(str, "r(%d) g(%d) b(%d)",
-            int(palette[i].red),
-            int(palette[i].green),
-            int(palette[i].blue));
-          COR_LOG(str);
-        }
-      }
-#endif
+    auto_array<png_bytep> rows;
+    auto_buffer<byte> scratch;
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /**
+   * Asks libpng for rows in target_format where it can produce them:
+   * in BGR order, with grey expanded to color, and with an alpha
+   * channel added or stripped.  Color to grey is left to the row
+   * converter, since libpng's rgb_to_gray weights and gamma handling
+   * differ from Corona's.
+   */
+  void SetTransformsPNG(PNGDecoder& d, PixelFormat target_format) {
+    const int color_type = png_get_color_type(d.png_ptr, d.info_ptr);
+    const bool color = (color_type & PNG_COLOR_MASK_COLOR) != 0;
+    const bool alpha = ((color_type & PNG_COLOR_MASK_ALPHA) != 0 ||
+                        png_get_valid(d.png_ptr, d.info_ptr, PNG_INFO_tRNS));
+
+    bool want_color, want_alpha;
+    switch (target_format) {
+      case PF_R8G8B8A8: want_color = true;  want_alpha = true;  break;
+      case PF_R8G8B8:   want_color = true;  want_alpha = false; break;
+      case PF_B8G8R8A8: want_color = true;  want_alpha = true;  break;
+      case PF_B8G8R8:   want_color = true;  want_alpha = false; break;
+      case PF_L8A8:     want_color = false; want_alpha = true;  break;
+      case PF_L8:       want_color = false; want_alpha = false; break;
+      default:          return;
+    }
 
-      memcpy(palette, png_palette, 256 * sizeof(png_color));
+    if (color && !want_color) {
+      return;
+    }
+    if (!color && want_color) {
+      png_set_gray_to_rgb(d.png_ptr);
+    }
+    if (target_format == PF_B8G8R8A8 || target_format == PF_B8G8R8) {
+      png_set_bgr(d.png_ptr);
+    }
+    if (alpha && !want_alpha) {
+      png_set_strip_alpha(d.png_ptr);
+    } else if (!alpha && want_alpha) {
+      png_set_add_alpha(d.png_ptr, 0xFF, PNG_FILLER_AFTER);
     }
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
-  Image* OpenPNG(File* file) {
-
-    COR_GUARD("OpenPNG");
-
+  /**
+   * Checks the signature, reads the chunks up to the image data, and
+   * sets up libpng to hand back rows of 8-bit samples, in
+   * target_format if SetTransformsPNG can arrange it.  Otherwise the
+   * rows are RGBA, RGB, grey+alpha, or grey, whichever the file holds.
+   * Returns false if the file isn't a PNG we can read.
+   */
+  bool StartPNG(PNGDecoder& d, File* file,
+                PixelFormat target_format = PF_DONTCARE) {
     // verify PNG signature
     byte sig[8];
-    file->read(sig, 8);
-    if (png_sig_cmp(sig, 0, 8)) {
-      return 0;
+    if (file->read(sig, 8) != 8 || png_sig_cmp(sig, 0, 8)) {
+      return false;
     }
 
     COR_LOG("Signature verified");
 
     // read struct
-    png_structp png_ptr = png_create_read_struct(
+    d.png_ptr = png_create_read_struct(
       PNG_LIBPNG_VER_STRING,
       NULL, NULL, NULL);
-    if (!png_ptr) {
-      return 0;
+    if (!d.png_ptr) {
+      return false;
     }
 
-    COR_LOG("png struct created");
-
     // info struct
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-      png_destroy_read_struct(&png_ptr, NULL, NULL);
-      return 0;
+    d.info_ptr = png_create_info_struct(d.png_ptr);
+    if (!d.info_ptr) {
+      return false;
     }
 
-    COR_LOG("info struct created");
-
     // the PNG error function calls longjmp(png_ptr->jmpbuf)
-    if (setjmp(png_jmpbuf(png_ptr))) {
-      COR_LOG("Error loading PNG");
-      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-      return 0;
+    if (setjmp(png_jmpbuf(d.png_ptr))) {
+      COR_LOG("Error reading PNG header");
+      return false;
     }
 
-    COR_LOG("setjmp() succeeded");
-
     // set the error function
-    png_set_error_fn(png_ptr, 0, PNG_error_function, PNG_warning_function);
+    png_set_error_fn(d.png_ptr, 0, PNG_error_function, PNG_warning_function);
+
+    png_set_read_fn(d.png_ptr, file, PNG_read_function);
+    png_set_sig_bytes(d.png_ptr, 8);  // we already read 8 bytes for the sig
+    png_read_info(d.png_ptr, d.info_ptr);
+
+    // always give us 8-bit samples (strip 16-bit and expand <8-bit),
+    // palettes expanded to RGB(A), and transparent colors expanded
+    // to an alpha channel.  greyscale stays greyscale
+    png_set_strip_16(d.png_ptr);
+    png_set_expand(d.png_ptr);
+    SetTransformsPNG(d, target_format);
+    d.passes = png_set_interlace_handling(d.png_ptr);
+    png_read_update_info(d.png_ptr, d.info_ptr);
+
+    d.width  = png_get_image_width(d.png_ptr, d.info_ptr);
+    d.height = png_get_image_height(d.png_ptr, d.info_ptr);
+    if (png_get_bit_depth(d.png_ptr, d.info_ptr) != 8) {
+      return false;
+    }
 
-    // read the image
-    png_set_read_fn(png_ptr, file, PNG_read_function);
-    png_set_sig_bytes(png_ptr, 8);  // we already read 8 bytes for the sig
-    // always give us 8-bit samples (strip 16-bit and expand <8-bit)
-    int png_transform = PNG_TRANSFORM_STRIP_16 | PNG_TRANSFORM_EXPAND;
-    png_read_png(png_ptr, info_ptr, png_transform, NULL);
+    const bool bgr = (target_format == PF_B8G8R8A8 ||
+                      target_format == PF_B8G8R8);
+    switch (png_get_channels(d.png_ptr, d.info_ptr)) {
+      case 4:  d.format = (bgr ? PF_B8G8R8A8 : PF_R8G8B8A8); return true;
+      case 3:  d.format = (bgr ? PF_B8G8R8   : PF_R8G8B8);   return true;
+      case 2:  d.format = PF_L8A8;                            return true;
+      case 1:  d.format = PF_L8;                              return true;
+      default: return false;
+    }
+  }
 
-    COR_LOG("PNG read");
+  //////////////////////////////////////////////////////////////////////////////
 
-    if (!png_get_rows(png_ptr, info_ptr)) {
-      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-      return 0;
+  /**
+   * Decodes every pass of the image into rows, which point at height
+   * rows of width pixels in d.format, and reads the rest of the file.
+   */
+  bool ReadImagePNG(PNGDecoder& d, png_bytepp rows) {
+    if (setjmp(png_jmpbuf(d.png_ptr))) {
+      COR_LOG("Error reading PNG image data");
+      return false;
     }
 
-    int width  = png_get_image_width(png_ptr, info_ptr);
-    int height = png_get_image_height(png_ptr, info_ptr);
-    byte* pixels = 0;  // allocate when we know the format
-    PixelFormat format;
-    byte* palette = 0;
-    PixelFormat palette_format;
-
-    // decode based on pixel format
-    int bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-    int num_channels = png_get_channels(png_ptr, info_ptr);
-    png_bytepp row_pointers = png_get_rows(png_ptr, info_ptr);
-
-    // 32-bit RGBA
-    if (bit_depth == 8 && num_channels == 4) {
-      COR_LOG("32-bit RGBA: bit_depth = 8 && num_channels = 4");
-
-      format = PF_R8G8B8A8;
-      pixels = new byte[width * height * 4];
-      for (int i = 0; i < height; ++i) {
-        memcpy(pixels + i * width * 4, row_pointers[i], width * 4);
-      }
+    png_read_image(d.png_ptr, rows);
+    png_read_end(d.png_ptr, NULL);
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /**
+   * Decodes height rows of width pixels into a buffer with the given
+   * pitch.
+   */
+  bool ReadImagePNG(PNGDecoder& d, byte* pixels, int pitch) {
+    d.rows = new png_bytep[d.height];
+    for (int i = 0; i < d.height; ++i) {
+      d.rows[i] = pixels + i * pitch;
+    }
+    return ReadImagePNG(d, d.rows);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /**
+   * Decodes one row at a time into d.scratch and converts it into
+   * target.  Only works for images that aren't interlaced.
+   */
+  bool ConvertRowsPNG(PNGDecoder& d, Image* target,
+                      const RowConverter& converter) {
+    if (setjmp(png_jmpbuf(d.png_ptr))) {
+      COR_LOG("Error reading PNG image data");
+      return false;
+    }
+
+    byte* out = (byte*)target->getPixels();
+    const int pitch = target->getPitch();
+    for (int i = 0; i < d.height; ++i) {
+      png_read_row(d.png_ptr, d.scratch, NULL);
+      converter.convert(out + i * pitch, d.scratch, d.width);
+    }
+    png_read_end(d.png_ptr, NULL);
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /**
+   * Decodes the image into target.  StartPNG has already asked libpng
+   * for rows in the target's format, so they are decoded right into
+   * it.  Only color images going into grey targets are decoded into
+   * scratch space and converted.
+   */
+  bool DecodeInto(PNGDecoder& d, Image* target) {
+    if (!CanDecodeInto(target, d.width, d.height)) {
+      return false;
+    }
+
+    const PixelFormat target_format = target->getFormat();
+    if (target_format == d.format) {
+      return ReadImagePNG(d, (byte*)target->getPixels(), target->getPitch());
+    }
+
+    RowConverter converter;
+    if (!converter.init(target_format, d.format)) {
+      return false;
+    }
 
-    // 24-bit RGB
-    } else if (bit_depth == 8 && num_channels == 3) {
-      COR_LOG("24-bit RGB: bit_depth = 8 && num_channels = 3");
+    const int row_size = d.width * GetPixelSize(d.format);
 
-      format = PF_R8G8B8;
-      pixels = new byte[width * height * 3];
-      for (int i = 0; i < height; ++i) {
-        memcpy(pixels + i * width * 3, row_pointers[i], width * 3);
+    // interlaced images have to be put together before converting them
+    if (d.passes > 1) {
+      d.scratch.allocate(row_size * d.height);
+      if (!d.scratch || !ReadImagePNG(d, d.scratch, row_size)) {
+        return false;
       }
 
-    // palettized or greyscale with alpha
-    } else if (bit_depth == 8 && (num_channels == 2 || num_channels == 1)) {
-      png_color png_palette[256];
-      fill_palette(png_ptr, info_ptr, png_palette);
-
-      if (num_channels == 2) {
-        COR_LOG("bit_depth = 8 && num_channels = 2");
-
-	format = PF_R8G8B8A8;
-	pixels = new byte[width * height * 4];
-	byte* out = pixels;
-
-        for (int i = 0; i < height; ++i) {
-          byte* in = row_pointers[i];
-          for (int j = 0; j < width; ++j) {
-            byte c = *in++;
-            *out++ = png_palette[c].red;
-            *out++ = png_palette[c].green;
-            *out++ = png_palette[c].blue;
-            *out++ = *in++;  // alpha
-          }
-        }
-
-      } else { // (num_channels == 1)
-        COR_LOG("bit_depth = 8 && num_channels = 1");
-
-        pixels = new byte[width * height];
-        format = PF_I8;
-        palette = new byte[256 * 4];
-        palette_format = PF_R8G8B8A8;
-
-
-        // get the transparent palette flags
-        png_bytep trans;
-        int num_trans = 0;
-        png_color_16p trans_values; // XXX not used - should be?
-        png_get_tRNS(png_ptr, info_ptr, &trans, &num_trans, &trans_values);
-
-        // copy the palette from the PNG
-        for (int i = 0; i < 256; ++i) {
-          palette[i * 4 + 0] = png_palette[i].red;
-          palette[i * 4 + 1] = png_palette[i].green;
-          palette[i * 4 + 2] = png_palette[i].blue;
-          palette[i * 4 + 3] = 255;
-        }
-        // apply transparency to palette entries
-        for (int i = 0; i < num_trans; ++i) {
-          palette[trans[i] * 4 + 3] = 0;
-        }
-
-        byte* out = pixels;
-        for (int i = 0; i < height; ++i) {
-          memcpy(out, row_pointers[i], width);
-          out += width;
-        }
+      byte* out = (byte*)target->getPixels();
+      const int pitch = target->getPitch();
+      for (int i = 0; i < d.height; ++i) {
+        converter.convert(out + i * pitch, d.scratch + i * row_size, d.width);
       }
+      return true;
+    }
+
+    d.scratch.allocate(row_size);
+    return d.scratch && ConvertRowsPNG(d, target, converter);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  Image* OpenPNG(File* file, Image* target) {
+
+    COR_GUARD("OpenPNG");
+
+    PNGDecoder d;
+    if (!StartPNG(d, file, (target ? target->getFormat() : PF_DONTCARE))) {
+      return 0;
+    }
+
+    COR_LOG("PNG header read");
+
+    // decoding into the caller's image
+    if (target) {
+      return (DecodeInto(d, target) ? target : 0);
+    }
 
-    } else {  // unknown format
-      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    // decode straight into the image's buffer
+    const int pitch = d.width * GetPixelSize(d.format);
+    auto_buffer<byte> pixels(pitch * d.height);
+    if (!pixels || !ReadImagePNG(d, pixels, pitch)) {
       return 0;
     }
 
-    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    COR_LOG("PNG read");
 
-    if (palette) {
-      return new SimpleImage(width, height, format, pixels,
-			     palette, 256, palette_format);
-    } else {
-      return new SimpleImage(width, height, format, pixels);
+    return new SimpleImage(d.width, d.height, d.format, pixels.release());
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  bool ProbePNG(File* file, ImageInfo& info) {
+
+    COR_GUARD("ProbePNG");
+
+    // reads the chunks up to the first IDAT, and works out the layout
+    // OpenPNG would decode to
+    PNGDecoder d;
+    if (!StartPNG(d, file)) {
+      return false;
     }
+
+    info.width  = d.width;
+    info.height = d.height;
+    info.format = d.format;
+    return true;
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -1,5 +1,7 @@
 #include <algorithm>
 #include <string.h>
+#include "Allocator.h"
+#include "BufferedFile.h"
 #include "Debug.h"
 #include "Open.h"
 #include "SimpleImage.h"
@@ -15,7 +17,7 @@ namespace corona {
    // bufferSize - buffer size in bytes
    // bpp        - bytes per pixel (8, 16, 24, 32)
    // fp         - file pointer, must be an opened file, ::use fseek to position at valid start of RLE row.
-   int ReadRLERow( unsigned char* data, const int& bufferSize, const int& bpp, File* file )
+   int ReadRLERow( unsigned char* data, const int& bufferSize, const int& bpp, BufferedFile* file )
    {
       unsigned int   value;
       unsigned char   byte;   // for reading byte by byte.
@@ -26,7 +28,7 @@ namespace corona {
 
       while ( n > 0 )
       {
-         if (file->read(&byte, 1) != 1) return -1;
+         if (!file->readByte(byte)) return -1;
          value = byte;
 
          if ( value & 0x80 )
@@ -64,9 +66,18 @@ namespace corona {
       return( 0 );
    }
 
+  Image* DecodeTGA(BufferedFile* file);
+
   Image* OpenTGA(File* file) {
     COR_GUARD("OpenTGA");
 
+    // RLE packets are only a few bytes long
+    BufferedFile buffered(file);
+    return DecodeTGA(&buffered);
+  }
+
+  Image* DecodeTGA(BufferedFile* file) {
+
     // read header
     byte header[18];
     if (file->read(header, 18) != 18) {
@@ -127,7 +138,7 @@ namespace corona {
 
     // read image data
     PixelFormat format;
-    auto_array<byte> pixels;
+    auto_buffer<byte> pixels;
     if (pixel_depth == 24) {
 
       COR_LOG("24-bit image");
@@ -135,7 +146,10 @@ namespace corona {
       int bytesPerPixel = (pixel_depth/8);
       format = PF_B8G8R8;
       int image_size = width * height * bytesPerPixel;
-      pixels = new byte[image_size];
+      pixels.allocate(image_size);
+      if (!pixels) {
+        return 0;
+      }
 
       if (image_type == 10)
       {
@@ -164,7 +178,10 @@ namespace corona {
       int bytesPerPixel = (pixel_depth/8);
       format = PF_B8G8R8A8;
       int image_size = width * height * bytesPerPixel;
-      pixels = new byte[image_size];
+      pixels.allocate(image_size);
+      if (!pixels) {
+        return 0;
+      }
 
       if (image_type == 10)
       {
@@ -239,4 +256,27 @@ namespace corona {
     return new SimpleImage(width, height, format, pixels.release());
   }
 
+  bool ProbeTGA(File* file, ImageInfo& info) {
+    COR_GUARD("ProbeTGA");
+
+    byte header[18];
+    if (file->read(header, 18) != 18) {
+      return false;
+    }
+
+    int image_type  = header[2];
+    int pixel_depth = header[16];
+
+    // same restrictions as OpenTGA
+    if ((image_type != 2 && image_type != 10) ||
+        (pixel_depth != 24 && pixel_depth != 32)) {
+      return false;
+    }
+
+    info.width  = read16_le(header + 12);
+    info.height = read16_le(header + 14);
+    info.format = (pixel_depth == 24 ? PF_B8G8R8 : PF_B8G8R8A8);
+    return true;
+  }
+
 }
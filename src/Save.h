@@ -7,10 +7,12 @@
 
 namespace corona {
 #ifndef NO_JPEG
-  bool SaveJPEG(File* file, Image* image); // SaveJPEG.cpp
+  bool SaveJPEG(File* file, Image* image,
+                const SaveOptions& options); // SaveJPEG.cpp
 #endif
 #ifndef NO_PNG
-  bool SavePNG(File* file, Image* image); // SavePNG.cpp
+  bool SavePNG(File* file, Image* image,
+               const SaveOptions& options); // SavePNG.cpp
 #endif
   bool SaveTGA(File* file, Image* image); // SaveTGA.cpp
 }
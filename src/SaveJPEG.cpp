@@ -1,10 +1,12 @@
 #include <stdio.h>  // needed by jpeglib.h
-#include <memory>
+#include <string.h>
+#include <algorithm>
 #include <setjmp.h>
 extern "C" {  // stupid JPEG library
   #include <jpeglib.h>
   #include <jerror.h>
 }
+#include "Convert.h"
 #include "Debug.h"
 #include "Save.h"
 #include "Utility.h"
@@ -12,6 +14,7 @@ extern "C" {  // stupid JPEG library
 namespace corona {
 
   static const int JPEG_BUFFER_SIZE = 4096;
+  static const int ROWS_PER_WRITE = 16;  // a full MCU row, even at 4:2:0
   void    JPEG_init_destination(j_compress_ptr cinfo);
   boolean JPEG_empty_output_buffer(j_compress_ptr cinfo);
   void    JPEG_term_destination(j_compress_ptr cinfo);
@@ -35,18 +38,118 @@ namespace corona {
     byte buffer[JPEG_BUFFER_SIZE];
   };
 
-  bool SaveJPEG(File* file, Image* source) {
+  static J_DCT_METHOD GetJPEGDCTMethod(DCTMethod method) {
+    switch (method) {
+      case DM_IFAST: return JDCT_IFAST;
+      case DM_FLOAT: return JDCT_FLOAT;
+      default:       return JDCT_ISLOW;
+    }
+  }
+
+  static ChromaSubsampling GetPlanarSubsampling(PixelFormat format) {
+    switch (format) {
+      case PF_YCbCr444: return SS_444;
+      case PF_YCbCr422: return SS_422;
+      default:          return SS_420;
+    }
+  }
+
+  /**
+   * Hands the planes of a planar image to a started raw data
+   * compression, an iMCU row at a time.  libjpeg reads whole blocks,
+   * so planes whose width isn't a multiple of the block size are
+   * copied into padded rows with the last sample repeated, and the
+   * last row of each plane stands in for the rows below it.  Other
+   * rows are read straight from the image.
+   */
+  static void WritePlanes(jpeg_compress_struct& cinfo, Image* image) {
+    const PixelFormat format = image->getFormat();
+    const int width  = image->getWidth();
+    const int height = image->getHeight();
+
+    JSAMPARRAY padded[3];
+    JSAMPROW rows[3][ROWS_PER_WRITE];
+    JSAMPARRAY planes[3] = { rows[0], rows[1], rows[2] };
+    for (int c = 0; c < 3; ++c) {
+      const jpeg_component_info& component = cinfo.comp_info[c];
+      const int padded_width = component.width_in_blocks * DCTSIZE;
+      padded[c] = 0;
+      if (padded_width != GetPlaneWidth(format, width, c)) {
+        // goes away with the compressor
+        padded[c] = (*cinfo.mem->alloc_sarray)(
+          (j_common_ptr)&cinfo, JPOOL_IMAGE,
+          padded_width, component.v_samp_factor * DCTSIZE);
+      }
+    }
+
+    const int lines = cinfo.max_v_samp_factor * DCTSIZE;
+    for (int call = 0; int(cinfo.next_scanline) < height; ++call) {
+      for (int c = 0; c < 3; ++c) {
+        const jpeg_component_info& component = cinfo.comp_info[c];
+        const int plane_width  = GetPlaneWidth(format, width, c);
+        const int plane_height = GetPlaneHeight(format, height, c);
+        const int padded_width = component.width_in_blocks * DCTSIZE;
+        const byte* plane = (const byte*)GetPlane(image, c);
+
+        const int count = component.v_samp_factor * DCTSIZE;
+        for (int i = 0; i < count; ++i) {
+          const int y = std::min(call * count + i, plane_height - 1);
+          const byte* row = plane + y * plane_width;
+          if (padded[c]) {
+            byte* out = (byte*)padded[c][i];
+            memcpy(out, row, plane_width);
+            memset(out + plane_width, row[plane_width - 1],
+                   padded_width - plane_width);
+            row = out;
+          }
+          rows[c][i] = (JSAMPROW)row;
+        }
+      }
+      jpeg_write_raw_data(&cinfo, planes, lines);
+    }
+  }
+
+  bool SaveJPEG(File* file, Image* image, const SaveOptions& options) {
     COR_GUARD("SaveJPG");
 
-    std::auto_ptr<Image> image(CloneImage(source, PF_R8G8B8));
-    if (!image.get()) {
+    if (options.jpeg_quality < 1 || options.jpeg_quality > 100 ||
+        options.jpeg_subsampling < SS_444 ||
+        options.jpeg_subsampling > SS_420 ||
+        options.jpeg_dct_method < DM_ISLOW ||
+        options.jpeg_dct_method > DM_FLOAT ||
+        options.jpeg_restart_interval < 0 ||
+        options.jpeg_restart_interval > 65535) {
+      return false;
+    }
+
+    // Greyscale images are saved as greyscale JPEGs, planar images
+    // go straight to the encoder as raw YCbCr, and everything else is
+    // saved as RGB.  Rows that aren't already in the format being
+    // written are converted one batch at a time.
+    const PixelFormat format = image->getFormat();
+    const bool grey = (format == PF_L8 || format == PF_L8A8);
+    const bool planar = IsPlanar(format);
+    const PixelFormat jpeg_format = (grey ? PF_L8 : PF_R8G8B8);
+    const int components = GetPixelSize(jpeg_format);
+
+    const bool convert = (format != jpeg_format && !planar);
+    RowConverter converter;
+    if (convert &&
+        !converter.init(jpeg_format, format,
+                        image->getPalette(), image->getPaletteSize(),
+                        image->getPaletteFormat())) {
+      COR_LOG("Unsupported pixel format");
       return false;
     }
+
     const int width  = image->getWidth();
+    const int height = image->getHeight();
+    const int row_size = width * components;
+    auto_array<byte> buffer(convert ? new byte[ROWS_PER_WRITE * row_size]
+                                    : 0);
 
     jpeg_compress_struct JpegInfo;
-    JSAMPROW row_pointer[1];
-    int Type = 0;
+    JSAMPROW row_pointers[ROWS_PER_WRITE];
 
     // Now we can initialize the JPEG compression object.
     jpeg_create_compress(&JpegInfo);
@@ -73,26 +176,72 @@ namespace corona {
     }	
 
     // image width and height, in pixels
-    JpegInfo.image_width  = image->getWidth();
-    JpegInfo.image_height = image->getHeight();
-    JpegInfo.input_components = 3;  // # of color components per pixel
-    JpegInfo.in_color_space = JCS_RGB;
+    JpegInfo.image_width  = width;
+    JpegInfo.image_height = height;
+    JpegInfo.input_components = components;
+    JpegInfo.in_color_space = (grey   ? JCS_GRAYSCALE :
+                               planar ? JCS_YCbCr : JCS_RGB);
 
     jpeg_set_defaults(&JpegInfo);
-    Type = Type;
     JpegInfo.write_JFIF_header = TRUE;
 
-    jpeg_set_quality(&JpegInfo, 85, TRUE);		// TODO: find way of setting quality
+    jpeg_set_quality(&JpegInfo, options.jpeg_quality, TRUE);
+
+    // jpeg_set_defaults() sets up 4:2:0, with the luminance sampled
+    // twice as often as the chrominance in both directions.
+    // greyscale has no chrominance to subsample, and planes are
+    // already subsampled
+    jpeg_component_info* luminance = &JpegInfo.comp_info[0];
+    const ChromaSubsampling subsampling =
+      (grey   ? SS_444 :
+       planar ? GetPlanarSubsampling(format) : options.jpeg_subsampling);
+    switch (subsampling) {
+      case SS_444:
+        luminance->h_samp_factor = 1;
+        luminance->v_samp_factor = 1;
+        break;
+      case SS_422:
+        luminance->h_samp_factor = 2;
+        luminance->v_samp_factor = 1;
+        break;
+      default:
+        luminance->h_samp_factor = 2;
+        luminance->v_samp_factor = 2;
+        break;
+    }
+
+    JpegInfo.optimize_coding  = (options.jpeg_optimize_coding ? TRUE : FALSE);
+    JpegInfo.dct_method       = GetJPEGDCTMethod(options.jpeg_dct_method);
+    JpegInfo.restart_interval = options.jpeg_restart_interval;
+    JpegInfo.raw_data_in      = (planar ? TRUE : FALSE);
 
     jpeg_start_compress(&JpegInfo, TRUE);
 
-    unsigned char * data = (unsigned char*)image->getPixels();
+    if (planar) {
+      WritePlanes(JpegInfo, image);
+      jpeg_finish_compress(&JpegInfo);
+      jpeg_destroy_compress(&JpegInfo);
+      return true;
+    }
+
+    // jpeg_write_scanlines takes an array of row pointers, so hand it
+    // several rows at a time
+    const byte* pixels = (const byte*)image->getPixels();
+    const int pitch = image->getPitch();
     while (JpegInfo.next_scanline < JpegInfo.image_height) {
-      // jpeg_write_scanlines expects an array of pointers to scanlines.
-      // Here the array is only one element long, but you could pass
-      // more than one scanline at a time if that's more convenient.
-      row_pointer[0] = &data[JpegInfo.next_scanline * (width * 3)];
-      jpeg_write_scanlines(&JpegInfo, row_pointer, 1);
+      const int first = JpegInfo.next_scanline;
+      const int rows = std::min(int(ROWS_PER_WRITE), height - first);
+      for (int i = 0; i < rows; ++i) {
+        const byte* row = pixels + (first + i) * pitch;
+        if (convert) {
+          byte* out = buffer.get() + i * row_size;
+          converter.convert(out, row, width);
+          row_pointers[i] = out;
+        } else {
+          row_pointers[i] = (JSAMPROW)row;
+        }
+      }
+      jpeg_write_scanlines(&JpegInfo, row_pointers, rows);
     }
 
     // Step 6: Finish compression
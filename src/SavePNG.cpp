@@ -1,7 +1,15 @@
+#include <algorithm>
 #include <memory>
+#include <new>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
 #include <png.h>
+#include <zlib.h>
+#include "Convert.h"
 #include "Debug.h"
 #include "Save.h"
+#include "Thread.h"
 #include "Types.h"
 
 namespace corona {
@@ -17,7 +25,438 @@ namespace corona {
     // assume that files always flush
   }
 
-  bool SavePNG(File* file, Image* image) {
+  int GetPNGStrategy(CompressionStrategy strategy) {
+    switch (strategy) {
+      case CS_FILTERED:     return Z_FILTERED;
+      case CS_HUFFMAN_ONLY: return Z_HUFFMAN_ONLY;
+#ifdef Z_RLE
+      case CS_RLE:          return Z_RLE;
+#else
+      // zlib before 1.2 can't match runs.  Huffman-only is the
+      // closest it has: just as fast, but the runs cost more.
+      case CS_RLE:          return Z_HUFFMAN_ONLY;
+#endif
+      default:              return Z_DEFAULT_STRATEGY;
+    }
+  }
+
+  int GetPNGFilter(RowFilter filter) {
+    switch (filter) {
+      case RF_NONE:    return PNG_FILTER_NONE;
+      case RF_SUB:     return PNG_FILTER_SUB;
+      case RF_UP:      return PNG_FILTER_UP;
+      case RF_AVERAGE: return PNG_FILTER_AVG;
+      case RF_PAETH:   return PNG_FILTER_PAETH;
+      default:         return PNG_ALL_FILTERS;
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Parallel encoding
+  //
+  // The rows are cut into chunks of about PARALLEL_CHUNK_SIZE filtered
+  // bytes.  Each chunk is filtered and then deflated on its own as a
+  // raw stream primed with the DICTIONARY_SIZE filtered bytes before
+  // it, the way pigz does it.  Every chunk but the last ends with a
+  // full flush, which leaves it on a byte boundary, so the pieces join
+  // into one zlib stream.  Chunk boundaries depend only on the image,
+  // so a file comes out the same from run to run and for any number
+  // of threads.
+  //
+  // The chunks are encoded in batches of CHUNKS_PER_WORKER per thread,
+  // and each batch is written out before the next one starts, so only
+  // a batch of compressed chunks is ever held in memory.  Each worker
+  // takes a run of neighboring chunks and carries the filtered rows
+  // at the end of one over as the dictionary of the next.  Only the
+  // first chunk of a run has to filter its dictionary rows again.
+
+  const int PARALLEL_CHUNK_SIZE = 128 * 1024;
+  const int DICTIONARY_SIZE     = 32 * 1024;
+  const int CHUNKS_PER_WORKER   = 4;
+
+  /// What every chunk needs to know.  Shared by all of the workers.
+  struct PNGEncoding {
+    const byte* pixels;
+    int pitch;
+    int width;
+    int height;
+    int pixel_size;
+    bool bgr;
+    int filter;          ///< PNG_FILTER_VALUE_*, or -1 to pick per row
+    int level;
+    int strategy;
+    int rows_per_chunk;
+    int chunk_count;
+    int dictionary_rows; ///< rows that cover DICTIONARY_SIZE bytes
+  };
+
+  struct PNGChunk {
+    std::vector<byte> compressed;
+    uLong adler;         ///< adler32 of the chunk's filtered data
+    uLong length;        ///< length of the chunk's filtered data
+    bool ok;
+  };
+
+  struct PNGWorker {
+    const PNGEncoding* encoding;
+    PNGChunk* chunks;    ///< this worker's run of chunks
+    int first;           ///< index of the first of them in the image
+    int count;
+  };
+
+  /// Filtered rows first through end - 1, the last chunk a worker
+  /// encoded and the dictionary rows before it.
+  struct PNGWindow {
+    std::vector<byte> rows;
+    int first;
+    int end;
+  };
+
+  /// Returns row y of the image in PNG's byte order, using buffer if
+  /// the channels have to be swapped.
+  const byte* GetPNGRow(const PNGEncoding& e, int y, byte* buffer) {
+    const byte* row = e.pixels + y * e.pitch;
+    if (!e.bgr) {
+      return row;
+    }
+    for (int x = 0; x < e.width; ++x) {
+      byte* out = buffer + x * e.pixel_size;
+      const byte* in = row + x * e.pixel_size;
+      out[0] = in[2];
+      out[1] = in[1];
+      out[2] = in[0];
+      if (e.pixel_size == 4) {
+        out[3] = in[3];
+      }
+    }
+    return buffer;
+  }
+
+  inline int Paeth(int a, int b, int c) {
+    const int p  = a + b - c;
+    const int pa = abs(p - a);
+    const int pb = abs(p - b);
+    const int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) {
+      return a;
+    } else if (pb <= pc) {
+      return b;
+    } else {
+      return c;
+    }
+  }
+
+  /// Writes the filter type and then the filtered bytes of row to out.
+  void FilterRow(byte* out, int filter, const byte* row, const byte* prev,
+                 int row_size, int bpp)
+  {
+    *out++ = byte(filter);
+    switch (filter) {
+      case PNG_FILTER_VALUE_NONE:
+        memcpy(out, row, row_size);
+        break;
+
+      case PNG_FILTER_VALUE_SUB:
+        for (int i = 0; i < bpp; ++i) {
+          out[i] = row[i];
+        }
+        for (int i = bpp; i < row_size; ++i) {
+          out[i] = byte(row[i] - row[i - bpp]);
+        }
+        break;
+
+      case PNG_FILTER_VALUE_UP:
+        for (int i = 0; i < row_size; ++i) {
+          out[i] = byte(row[i] - prev[i]);
+        }
+        break;
+
+      case PNG_FILTER_VALUE_AVG:
+        for (int i = 0; i < bpp; ++i) {
+          out[i] = byte(row[i] - prev[i] / 2);
+        }
+        for (int i = bpp; i < row_size; ++i) {
+          out[i] = byte(row[i] - (row[i - bpp] + prev[i]) / 2);
+        }
+        break;
+
+      case PNG_FILTER_VALUE_PAETH:
+        for (int i = 0; i < bpp; ++i) {
+          out[i] = byte(row[i] - prev[i]);
+        }
+        for (int i = bpp; i < row_size; ++i) {
+          out[i] = byte(row[i] - Paeth(row[i - bpp], prev[i], prev[i - bpp]));
+        }
+        break;
+    }
+  }
+
+  /// Filters row with each filter in turn and keeps the one whose
+  /// output, read as signed bytes, is smallest.  This is libpng's
+  /// heuristic.  scratch holds one filtered row.
+  void FilterRowAdaptive(byte* out, const byte* row, const byte* prev,
+                         int row_size, int bpp, byte* scratch)
+  {
+    unsigned long best_sum = 0;
+    for (int filter = 0; filter < PNG_FILTER_VALUE_LAST; ++filter) {
+      byte* candidate = (filter == 0 ? out : scratch);
+      FilterRow(candidate, filter, row, prev, row_size, bpp);
+
+      unsigned long sum = 0;
+      for (int i = 1; i <= row_size; ++i) {
+        const int v = candidate[i];
+        sum += (v < 128 ? v : 256 - v);
+      }
+      if (filter == 0 || sum < best_sum) {
+        best_sum = sum;
+        if (candidate != out) {
+          memcpy(out, candidate, row_size + 1);
+        }
+      }
+    }
+  }
+
+  int GetRowStride(const PNGEncoding& e) {
+    return e.width * e.pixel_size + 1;  // with the filter type byte
+  }
+
+  /// Filters rows first through end - 1 into out.
+  void FilterRows(const PNGEncoding& e, int first, int end, byte* out) {
+    const int row_size = e.width * e.pixel_size;
+    const int stride   = GetRowStride(e);
+    if (first >= end) {
+      return;
+    }
+
+    std::vector<byte> buffers(row_size * 2);
+    std::vector<byte> zero_row(row_size);
+    std::vector<byte> scratch(e.filter == -1 ? stride : 0);
+
+    byte* buffer      = &buffers[0];
+    byte* prev_buffer = &buffers[row_size];
+    const byte* prev = (first == 0 ?
+                        &zero_row[0] :
+                        GetPNGRow(e, first - 1, prev_buffer));
+
+    for (int y = first; y < end; ++y) {
+      const byte* row = GetPNGRow(e, y, buffer);
+      if (e.filter == -1) {
+        FilterRowAdaptive(out, row, prev, row_size, e.pixel_size,
+                          &scratch[0]);
+      } else {
+        FilterRow(out, e.filter, row, prev, row_size, e.pixel_size);
+      }
+      out += stride;
+      prev = row;
+      std::swap(buffer, prev_buffer);
+    }
+  }
+
+  /// Filters and compresses one chunk.  window holds the rows the
+  /// worker filtered for its last chunk.
+  bool EncodeChunk(const PNGEncoding& e, int index, PNGWindow& window,
+                   PNGChunk& chunk)
+  {
+    const int stride = GetRowStride(e);
+    const int first_row = index * e.rows_per_chunk;
+    const int end_row = std::min(first_row + e.rows_per_chunk, e.height);
+    const int context_first = std::max(0, first_row - e.dictionary_rows);
+    const int context_rows = first_row - context_first;
+
+    // the dictionary rows end the window if this worker just encoded
+    // the chunk before
+    byte* rows = &window.rows[0];
+    if (window.end == first_row && context_rows > 0) {
+      memmove(rows, rows + (context_first - window.first) * stride,
+              context_rows * stride);
+    } else {
+      FilterRows(e, context_first, first_row, rows);
+    }
+    FilterRows(e, first_row, end_row, rows + context_rows * stride);
+    window.first = context_first;
+    window.end   = end_row;
+
+    byte* data = rows + context_rows * stride;
+    const int length = (end_row - first_row) * stride;
+    chunk.length = length;
+    chunk.adler = adler32(adler32(0, Z_NULL, 0), data, length);
+
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (deflateInit2(&z, e.level, Z_DEFLATED, -MAX_WBITS, 8, e.strategy)
+        != Z_OK) {
+      return false;
+    }
+
+    if (context_rows > 0) {
+      const int size = std::min(DICTIONARY_SIZE, context_rows * stride);
+      deflateSetDictionary(&z, data - size, size);
+    }
+
+    const bool last = (index == e.chunk_count - 1);
+    const int flush = (last ? Z_FINISH : Z_FULL_FLUSH);
+
+    chunk.compressed.resize(length + length / 1000 + 64);
+    z.next_in  = data;
+    z.avail_in = length;
+    int produced = 0;
+    bool ok;
+    for (;;) {
+      z.next_out  = &chunk.compressed[produced];
+      z.avail_out = int(chunk.compressed.size()) - produced;
+      const int result = deflate(&z, flush);
+      produced = int(chunk.compressed.size()) - z.avail_out;
+
+      ok = (result == Z_OK || result == Z_STREAM_END);
+      if (!ok || result == Z_STREAM_END || (!last && z.avail_out != 0)) {
+        break;
+      }
+      chunk.compressed.resize(chunk.compressed.size() * 2);
+    }
+    chunk.compressed.resize(produced);
+
+    deflateEnd(&z);
+    return ok;
+  }
+
+  void EncodeChunks(void* data) {
+    PNGWorker* worker = (PNGWorker*)data;
+    const PNGEncoding& e = *worker->encoding;
+
+    // an exception can't be allowed to escape the thread.  chunks
+    // that weren't encoded are still marked as failed
+    try {
+      PNGWindow window;
+      window.rows.resize((e.dictionary_rows + e.rows_per_chunk) *
+                         GetRowStride(e));
+      window.first = window.end = -1;
+      for (int i = 0; i < worker->count; ++i) {
+        worker->chunks[i].ok =
+          EncodeChunk(e, worker->first + i, window, worker->chunks[i]);
+      }
+    }
+    catch (const std::bad_alloc&) {
+    }
+  }
+
+  /// zlib's adler32_combine, which older zlibs don't have: the adler32
+  /// of two blocks of data, given the adler32 of each.
+  uLong CombineAdler32(uLong adler1, uLong adler2, uLong length2) {
+    const uLong BASE = 65521;
+    const uLong rem = length2 % BASE;
+    uLong sum1 = adler1 & 0xffff;
+    uLong sum2 = (rem * sum1) % BASE;
+    sum1 += (adler2 & 0xffff) + BASE - 1;
+    sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + BASE - rem;
+    if (sum1 >= BASE) sum1 -= BASE;
+    if (sum1 >= BASE) sum1 -= BASE;
+    if (sum2 >= (BASE << 1)) sum2 -= (BASE << 1);
+    if (sum2 >= BASE) sum2 -= BASE;
+    return sum1 | (sum2 << 16);
+  }
+
+  /**
+   * Compresses the image on up to thread_count threads and writes it
+   * as IDAT chunks followed by IEND.  Returns false if a chunk couldn't
+   * be compressed or written.
+   */
+  bool WritePNGParallel(png_structp png_ptr, const PNGEncoding& e,
+                        int thread_count)
+  {
+    thread_count = std::min(thread_count, e.chunk_count);
+    const int batch_size = std::min(thread_count * CHUNKS_PER_WORKER,
+                                    e.chunk_count);
+    std::vector<PNGChunk> chunks(batch_size);
+    std::vector<PNGWorker> workers(thread_count);
+    std::vector<void*> data(thread_count);
+
+    // the zlib header, as deflateInit would have written it
+    int level_flags;
+    if (e.strategy == Z_HUFFMAN_ONLY || e.level < 2) {
+      level_flags = 0;
+    } else if (e.level < 6) {
+      level_flags = 1;
+    } else if (e.level == 6) {
+      level_flags = 2;
+    } else {
+      level_flags = 3;
+    }
+    int header = ((0x70 | Z_DEFLATED) << 8) | (level_flags << 6);
+    header += 31 - header % 31;
+    const byte zlib_header[2] = { byte(header >> 8), byte(header) };
+
+    // a write error jumps back here, so the chunks still get freed.
+    // nothing below constructs anything that needs destroying
+    if (setjmp(png_jmpbuf(png_ptr))) {
+      return false;
+    }
+
+    uLong adler = adler32(0, Z_NULL, 0);
+    for (int batch = 0; batch < e.chunk_count; batch += batch_size) {
+      const int count = std::min(batch_size, e.chunk_count - batch);
+
+      // split the batch into runs of neighboring chunks
+      int worker_count = 0;
+      for (int i = 0; i < thread_count; ++i) {
+        const int begin = count * i / thread_count;
+        const int end   = count * (i + 1) / thread_count;
+        if (begin == end) {
+          continue;
+        }
+        PNGWorker& worker = workers[worker_count];
+        worker.encoding = &e;
+        worker.chunks   = &chunks[begin];
+        worker.first    = batch + begin;
+        worker.count    = end - begin;
+        data[worker_count++] = &worker;
+      }
+      for (int i = 0; i < count; ++i) {
+        chunks[i].ok = false;
+      }
+      RunInParallel(EncodeChunks, &data[0], worker_count);
+
+      // one IDAT per chunk, in order
+      for (int i = 0; i < count; ++i) {
+        PNGChunk& chunk = chunks[i];
+        if (!chunk.ok) {
+          return false;
+        }
+        adler = CombineAdler32(adler, chunk.adler, chunk.length);
+
+        const bool first = (batch + i == 0);
+        const bool last  = (batch + i == e.chunk_count - 1);
+        const byte zlib_trailer[4] = {
+          byte(adler >> 24), byte(adler >> 16), byte(adler >> 8), byte(adler),
+        };
+
+        const png_uint_32 length = png_uint_32(chunk.compressed.size() +
+                                               (first ? 2 : 0) +
+                                               (last  ? 4 : 0));
+        png_write_chunk_start(png_ptr, (png_const_bytep)"IDAT", length);
+        if (first) {
+          png_write_chunk_data(png_ptr, (png_bytep)zlib_header, 2);
+        }
+        if (!chunk.compressed.empty()) {
+          png_write_chunk_data(png_ptr, &chunk.compressed[0],
+                               chunk.compressed.size());
+        }
+        if (last) {
+          png_write_chunk_data(png_ptr, (png_bytep)zlib_trailer, 4);
+        }
+        png_write_chunk_end(png_ptr);
+
+        // let go of the memory as we go
+        std::vector<byte>().swap(chunk.compressed);
+      }
+    }
+
+    png_write_chunk(png_ptr, (png_const_bytep)"IEND", 0, 0);
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+
+  bool SavePNG(File* file, Image* image, const SaveOptions& options) {
     COR_GUARD("SavePNG");
 
     if (!image) {
@@ -25,19 +464,33 @@ namespace corona {
     }
 
     // If the image format isn't supported directly by this function,
-    // clone to a supported format and try to save with that.
+    // clone to a supported format and try to save with that.  BGR
+    // images are swapped by libpng as it writes them.
     switch (image->getFormat()) {
       case PF_R8G8B8A8:
       case PF_R8G8B8:
+      case PF_B8G8R8A8:
+      case PF_B8G8R8:
+      case PF_L8A8:
+      case PF_L8:
       case PF_I8:
 	break;
       default: {
 	COR_LOG("Unsupported pixel format... cloning");
 	std::auto_ptr<Image> cloned(CloneImage(image, PF_R8G8B8A8));
-	return SavePNG(file, cloned.get());
+	return SavePNG(file, cloned.get(), options);
       }
     }
 
+    if (options.png_compression_level < -1 ||
+        options.png_compression_level > 9 ||
+        options.png_strategy < CS_DEFAULT ||
+        options.png_strategy > CS_RLE ||
+        options.png_filter < RF_ADAPTIVE ||
+        options.png_filter > RF_PAETH) {
+      return false;
+    }
+
     // create write struct
     png_structp png_ptr = png_create_write_struct(
       PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -65,22 +518,33 @@ namespace corona {
     png_set_write_fn(png_ptr, file, PNG_write, PNG_flush);
 
     int color_format = 0; // png output format
-    int color_format_bpp = 0; // png bytes per pixel
     bool color_format_paletted = false; // png palette needed flag
+    bool color_format_bgr = false; // swap red and blue
 
     // figure out output format
     switch (image->getFormat()) {
       case PF_R8G8B8A8:
         color_format = PNG_COLOR_TYPE_RGB_ALPHA;
-        color_format_bpp = 4;
         break;
       case PF_R8G8B8:
         color_format = PNG_COLOR_TYPE_RGB;
-        color_format_bpp = 3;
+        break;
+      case PF_B8G8R8A8:
+        color_format = PNG_COLOR_TYPE_RGB_ALPHA;
+        color_format_bgr = true;
+        break;
+      case PF_B8G8R8:
+        color_format = PNG_COLOR_TYPE_RGB;
+        color_format_bgr = true;
+        break;
+      case PF_L8A8:
+        color_format = PNG_COLOR_TYPE_GRAY_ALPHA;
+        break;
+      case PF_L8:
+        color_format = PNG_COLOR_TYPE_GRAY;
         break;
       case PF_I8:
         color_format = PNG_COLOR_TYPE_PALETTE;
-        color_format_bpp = 1;
         color_format_paletted = true;
         break;
       default:
@@ -103,61 +567,106 @@ namespace corona {
     if (color_format_paletted) {
       COR_LOG("Saving palettized image...");
 
-      int image_palette_format = image->getPaletteFormat(); // palette format
-      int image_palette_size = image->getPaletteSize(); // palette size
+      const PixelFormat image_palette_format = image->getPaletteFormat();
+      const int image_palette_size = image->getPaletteSize();
 
-      // allocate png palette and get pointer to image palette
+      // png_color is three bytes of red, green, and blue, so the
+      // palette converts straight into it
       png_palette = (png_color*)png_malloc(
         png_ptr, sizeof(png_color) * image_palette_size);
-      byte* image_palette = (byte*)image->getPalette();
-
-
-      if (image_palette_format == PF_R8G8B8) {
-	// 24 bit source palette
-	for (int i = 0; i < image_palette_size; i++) {
-	  // copy entry directly
-	  png_palette[i].red   = *image_palette++;
-	  png_palette[i].green = *image_palette++;
-	  png_palette[i].blue  = *image_palette++;
-	}
-      } else if (image_palette_format == PF_R8G8B8A8) {
-	// 32 bit source palette
-	for (int i = 0; i < image_palette_size; i++) {
-	  // copy entry, skip alpha
-	  png_palette[i].red   = *image_palette++;
-	  png_palette[i].green = *image_palette++;
-	  png_palette[i].blue  = *image_palette++;
-	  image_palette++;
-	}
+      if (!ConvertPixels((byte*)png_palette, PF_R8G8B8,
+                         (const byte*)image->getPalette(),
+                         image_palette_format, image_palette_size)) {
+        png_free(png_ptr, png_palette);
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return false;
       }
+
       // write palette
       png_set_PLTE(png_ptr, info_ptr, png_palette, image_palette_size);
     }
 
-    byte* pixels = (byte*)image->getPixels();
-
-    // build rows
-    void** rows = (void**)png_malloc(png_ptr, sizeof(void*) * height);
-    for (int i = 0; i < height; ++i) {
-      rows[i] = png_malloc(png_ptr, color_format_bpp * width);
-      memcpy(rows[i], pixels, color_format_bpp * width);
-      pixels += width * color_format_bpp;      
+    // encoder settings
+    if (options.png_compression_level != -1) {
+      png_set_compression_level(png_ptr, options.png_compression_level);
+    }
+    if (options.png_strategy != CS_DEFAULT) {
+      png_set_compression_strategy(
+        png_ptr, GetPNGStrategy(options.png_strategy));
+    }
+    if (options.png_filter != RF_ADAPTIVE) {
+      png_set_filter(
+        png_ptr, PNG_FILTER_TYPE_BASE, GetPNGFilter(options.png_filter));
     }
-    png_set_rows(png_ptr, info_ptr, (png_bytepp)rows);
 
-		//zero 28-sep-2012 - it was never necessary, at least as far back as png 1.2.1, to set this
-		//png_set_rows sets it.
-		//good thing, because info_ptr is private >= png 1.5
-    //info_ptr->valid |= PNG_INFO_IDAT;
+    png_write_info(png_ptr, info_ptr);
 
-    // actually write the image
-    png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+    const byte* pixels = (const byte*)image->getPixels();
+    const int pitch = image->getPitch();
+    const int pixel_size = GetPixelSize(image->getFormat());
 
-    // clean up memory
+    // big images can be compressed in pieces on several threads
+    const int row_size = width * pixel_size + 1;
+    const int rows_per_chunk = std::max(1, PARALLEL_CHUNK_SIZE / row_size);
+    const int chunk_count = (height + rows_per_chunk - 1) / rows_per_chunk;
+
+    if (options.threads > 1 && chunk_count > 1) {
+      PNGEncoding e;
+      e.pixels     = pixels;
+      e.pitch      = pitch;
+      e.width      = width;
+      e.height     = height;
+      e.pixel_size = pixel_size;
+      e.bgr        = color_format_bgr;
+
+      // libpng doesn't filter palettized images unless asked to
+      if (options.png_filter != RF_ADAPTIVE) {
+        e.filter = options.png_filter - RF_NONE;
+      } else if (color_format_paletted) {
+        e.filter = PNG_FILTER_VALUE_NONE;
+      } else {
+        e.filter = -1;
+      }
+
+      e.level = (options.png_compression_level == -1 ?
+                 Z_DEFAULT_COMPRESSION : options.png_compression_level);
+      if (e.level == Z_DEFAULT_COMPRESSION) {
+        e.level = 6;
+      }
+
+      // same as libpng: filtered data gets Z_FILTERED by default
+      if (options.png_strategy != CS_DEFAULT) {
+        e.strategy = GetPNGStrategy(options.png_strategy);
+      } else if (e.filter != PNG_FILTER_VALUE_NONE) {
+        e.strategy = Z_FILTERED;
+      } else {
+        e.strategy = Z_DEFAULT_STRATEGY;
+      }
+
+      e.rows_per_chunk  = rows_per_chunk;
+      e.chunk_count     = chunk_count;
+      e.dictionary_rows = (DICTIONARY_SIZE + row_size - 1) / row_size;
+
+      const bool written = WritePNGParallel(png_ptr, e, options.threads);
+      if (png_palette) {
+        png_free(png_ptr, png_palette);
+      }
+      png_destroy_write_struct(&png_ptr, &info_ptr);
+      return written;
+    }
+
+    if (color_format_bgr) {
+      png_set_bgr(png_ptr);
+    }
+
+    // libpng copies each row before filtering it, so the rows can come
+    // straight from the image
     for (int i = 0; i < height; ++i) {
-      png_free(png_ptr, rows[i]);
+      png_write_row(png_ptr, (png_bytep)pixels);
+      pixels += pitch;
     }
-    png_free(png_ptr, rows);
+
+    png_write_end(png_ptr, info_ptr);
 
     if (png_palette) {
       png_free(png_ptr, png_palette);
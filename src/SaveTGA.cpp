@@ -15,9 +15,16 @@ namespace corona {
   bool SaveTGA(File* file, Image* source) {
     COR_GUARD("SaveTGA");
 
-    std::auto_ptr<Image> image(CloneImage(source, PF_B8G8R8A8));
-    if (!image.get()) {
-      return false;
+    // TGA stores BGRA, so images already in that format are written
+    // straight from their own rows
+    std::auto_ptr<Image> cloned;
+    Image* image = source;
+    if (source->getFormat() != PF_B8G8R8A8) {
+      cloned.reset(CloneImage(source, PF_B8G8R8A8));
+      image = cloned.get();
+      if (!image) {
+        return false;
+      }
     }
 
     const int width  = image->getWidth();
@@ -43,9 +50,20 @@ namespace corona {
     }
 
     // write pixels
-    const int data_size = width * height * 4;
-    if (file->write(image->getPixels(), data_size) != data_size) {
-      return false;
+    const byte* pixels = (const byte*)image->getPixels();
+    const int row_size = width * 4;
+    const int pitch    = image->getPitch();
+    if (pitch == row_size) {
+      const int data_size = row_size * height;
+      if (file->write(pixels, data_size) != data_size) {
+        return false;
+      }
+    } else {
+      for (int h = 0; h < height; ++h) {
+        if (file->write(pixels + h * pitch, row_size) != row_size) {
+          return false;
+        }
+      }
     }
 
     return true;
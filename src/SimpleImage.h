@@ -3,6 +3,7 @@
 
 
 #include "corona.h"
+#include "Allocator.h"
 #include "Types.h"
 #include "Utility.h"
 
@@ -14,7 +15,8 @@ namespace corona {
    * format, and a 2D array of pixels (one-byte packing).
    *
    * The constructor takes a pixel buffer (and optionally a palette)
-   * which it then owns and delete[]'s when the image is destroyed.
+   * from AllocateBuffer() which it then owns and frees when the image
+   * is destroyed, unless setDeleter() says otherwise.
    */
   class SimpleImage : public DLLImplementation<Image> {
   public:
@@ -27,7 +29,8 @@ namespace corona {
      * @param format          format that the pixels are stored in
      * @param pixels          pixel buffer that the SimpleImage takes
                               ownership of.  it should be
-                              width*height*sizeof(pixel) bytes.
+                              width*height*sizeof(pixel) bytes, or
+                              hold all the planes of a planar format.
      * @param palette         palette color buffer
      * @param palette_size    number of entries in palette
      * @param palette_format  color format palette is stored as
@@ -47,14 +50,30 @@ namespace corona {
       m_palette        = palette;
       m_palette_size   = palette_size;
       m_palette_format = palette_format;
+      m_pitch          = (IsPlanar(format) ?
+                          width : width * GetPixelSize(format));
+      m_deleter        = GetBufferDeleter(&m_user_data);
+      m_alignment      = BUFFER_ALIGNMENT;
     }
 
     /**
      * Destroys the image, freeing the owned pixel buffer and palette.
+     * The deleter is told their sizes, which are worked out from the
+     * image's dimensions the same way they were when allocated.
      */
     ~SimpleImage() {
-      delete[] m_pixels;
-      delete[] m_palette;
+      if (m_deleter) {
+        if (m_pixels) {
+          const int size = (IsPlanar(m_format) ?
+                            GetPlaneOffset(m_format, m_width, m_height, 3) :
+                            m_pitch * m_height);
+          m_deleter(m_pixels, size, m_alignment, m_user_data);
+        }
+        if (m_palette) {
+          const int size = m_palette_size * GetPixelSize(m_palette_format);
+          m_deleter(m_palette, size, m_alignment, m_user_data);
+        }
+      }
     }
 
     int COR_CALL getWidth() {
@@ -85,6 +104,52 @@ namespace corona {
       return m_palette_format;
     }
 
+    int COR_CALL getPitch() {
+      return m_pitch;
+    }
+
+    /**
+     * Changes the pixel format without touching the pixel buffer.
+     * Call this after rewriting the pixels in place.  The new format
+     * must have the same pixel size as the old one.
+     *
+     * @param format  format the pixels are now stored in
+     */
+    void setFormat(PixelFormat format) {
+      m_format = format;
+    }
+
+    /**
+     * Sets the distance between rows in the pixel buffer.  By default
+     * rows are tightly packed.
+     */
+    void setPitch(int pitch) {
+      m_pitch = pitch;
+    }
+
+    /**
+     * Changes how the buffers are freed when the image is destroyed.
+     *
+     * @param deleter    called for the pixels and the palette, or 0 if
+     *                   the image doesn't own them
+     * @param user_data  passed to deleter
+     * @param alignment  passed to deleter, the alignment the buffers
+     *                   were allocated with
+     */
+    void setDeleter(BufferDeleter deleter, void* user_data,
+                    int alignment = BUFFER_ALIGNMENT) {
+      m_deleter   = deleter;
+      m_user_data = user_data;
+      m_alignment = alignment;
+    }
+
+    /**
+     * Returns true if the image frees its buffers when destroyed.
+     */
+    bool ownsPixels() const {
+      return m_deleter != 0;
+    }
+
   private:
     int         m_width;
     int         m_height;
@@ -93,6 +158,11 @@ namespace corona {
     byte*       m_palette;
     int         m_palette_size;
     PixelFormat m_palette_format;
+    int         m_pitch;
+
+    BufferDeleter m_deleter;
+    void*         m_user_data;
+    int           m_alignment;
   };
 
 }
@@ -0,0 +1,87 @@
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX  // keep std::min usable
+  #include <windows.h>
+  #include <process.h>
+#else
+  #include <pthread.h>
+#endif
+#include <vector>
+#include "Thread.h"
+
+
+namespace corona {
+
+  struct ThreadStart {
+    ThreadFunction function;
+    void* data;
+    bool started;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t thread;
+#endif
+  };
+
+#ifdef _WIN32
+
+  unsigned __stdcall ThreadMain(void* start) {
+    ThreadStart* s = (ThreadStart*)start;
+    s->function(s->data);
+    return 0;
+  }
+
+  bool StartThread(ThreadStart& start) {
+    // _beginthreadex, unlike CreateThread, sets up the C runtime
+    start.handle = (HANDLE)_beginthreadex(0, 0, ThreadMain, &start, 0, 0);
+    return start.handle != 0;
+  }
+
+  void JoinThread(ThreadStart& start) {
+    WaitForSingleObject(start.handle, INFINITE);
+    CloseHandle(start.handle);
+  }
+
+#else
+
+  void* ThreadMain(void* start) {
+    ThreadStart* s = (ThreadStart*)start;
+    s->function(s->data);
+    return 0;
+  }
+
+  bool StartThread(ThreadStart& start) {
+    return pthread_create(&start.thread, 0, ThreadMain, &start) == 0;
+  }
+
+  void JoinThread(ThreadStart& start) {
+    pthread_join(start.thread, 0);
+  }
+
+#endif
+
+
+  void RunInParallel(ThreadFunction function, void** data, int count) {
+    if (count <= 0) {
+      return;
+    }
+
+    std::vector<ThreadStart> starts(count);
+    for (int i = 1; i < count; ++i) {
+      starts[i].function = function;
+      starts[i].data     = data[i];
+      starts[i].started  = StartThread(starts[i]);
+    }
+
+    function(data[0]);
+
+    for (int i = 1; i < count; ++i) {
+      if (starts[i].started) {
+        JoinThread(starts[i]);
+      } else {
+        function(data[i]);
+      }
+    }
+  }
+
+}
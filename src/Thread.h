@@ -0,0 +1,23 @@
+#ifndef CORONA_THREAD_H
+#define CORONA_THREAD_H
+
+
+namespace corona {
+
+  /// A task for RunInParallel().
+  typedef void (*ThreadFunction)(void* data);
+
+  /**
+   * Calls function(data[i]) for each of the count tasks, each on its
+   * own thread, and returns when they have all finished.  The first
+   * task runs on the calling thread.  If a thread can't be started,
+   * its task runs on the calling thread instead, so every task always
+   * runs exactly once.
+   */
+  void RunInParallel(ThreadFunction function, void** data, int count);
+                                                          // Thread.cpp
+
+}
+
+
+#endif
@@ -1,6 +1,6 @@
 /**
  * Corona Image I/O Library
- * Version 1.0.2
+ * Version 1.1.0
  * (c) 2003 Chad Austin
  *
  * This API uses principles explained at
@@ -78,7 +78,7 @@ namespace corona {
 
   /**
    * Pixel format specifications.  Pixel data can be packed in one of
-   * the following ways.
+   * the following ways.  The YCbCr formats are planar: see IsPlanar().
    */
   enum PixelFormat {
     PF_DONTCARE = 0x0200,  /**< special format used when specifying a
@@ -88,6 +88,12 @@ namespace corona {
     PF_I8       = 0x0203,  /**< Palettized, 8-bit indices into palette      */
     PF_B8G8R8A8 = 0x0204,  /**< BGRA, channels have eight bits of precision */
     PF_B8G8R8   = 0x0205,  /**< BGR, channels have eight bits of precision  */
+    PF_L8       = 0x0206,  /**< greyscale, eight bits of luminance          */
+    PF_L8A8     = 0x0207,  /**< greyscale followed by eight bits of alpha   */
+    PF_YCbCr444 = 0x0208,  /**< planar JPEG YCbCr, full size chroma         */
+    PF_YCbCr422 = 0x0209,  /**< planar JPEG YCbCr, half width chroma        */
+    PF_YCbCr420 = 0x020A,  /**< planar JPEG YCbCr, half width, half height
+                                chroma */
   };
 
   /**
@@ -99,6 +105,51 @@ namespace corona {
     CA_Y     = 0x0002,
   };
 
+  /**
+   * zlib compression strategies for saving PNG files.  See SaveOptions.
+   */
+  enum CompressionStrategy {
+    CS_DEFAULT      = 0x0300,  /**< libpng's choice, usually CS_FILTERED  */
+    CS_FILTERED     = 0x0301,  /**< favors literals over short matches    */
+    CS_HUFFMAN_ONLY = 0x0302,  /**< no matching at all, just entropy coding */
+    CS_RLE          = 0x0303,  /**< only matches against the previous byte */
+  };
+
+  /**
+   * PNG row filters.  Each row of a PNG is stored as the difference
+   * from a prediction, which is what the filter chooses.  See
+   * SaveOptions.
+   */
+  enum RowFilter {
+    RF_ADAPTIVE = 0x0400,  /**< pick the best filter for each row       */
+    RF_NONE     = 0x0401,  /**< no prediction                           */
+    RF_SUB      = 0x0402,  /**< predict from the pixel to the left      */
+    RF_UP       = 0x0403,  /**< predict from the pixel above            */
+    RF_AVERAGE  = 0x0404,  /**< predict from the average of those two   */
+    RF_PAETH    = 0x0405,  /**< predict from left, above, or upper left */
+  };
+
+  /**
+   * JPEG chroma subsampling.  The color (chrominance) channels can be
+   * stored at a lower resolution than the brightness, which the eye is
+   * less sensitive to.  See SaveOptions.
+   */
+  enum ChromaSubsampling {
+    SS_444 = 0x0500,  /**< full color resolution                     */
+    SS_422 = 0x0501,  /**< half the color resolution horizontally    */
+    SS_420 = 0x0502,  /**< half the color resolution in both directions */
+  };
+
+  /**
+   * Ways of computing the JPEG discrete cosine transform.  See
+   * SaveOptions.
+   */
+  enum DCTMethod {
+    DM_ISLOW = 0x0600,  /**< accurate integer method                 */
+    DM_IFAST = 0x0601,  /**< faster, slightly less accurate integers  */
+    DM_FLOAT = 0x0602,  /**< floating point, accurate but often slower */
+  };
+
   /**
    * A helper class for DLL-compatible interfaces.  Derive your cross-DLL
    * interfaces from this class.
@@ -213,6 +264,17 @@ namespace corona {
      * @return  pixel format of palette entries
      */
     virtual PixelFormat COR_CALL getPaletteFormat() = 0;
+
+    /**
+     * Get the distance in bytes from the start of one row of pixels
+     * to the start of the next.  It is at least the width times the
+     * pixel size.  Images with tightly packed rows don't need to
+     * override this.  Planar images are always tightly packed, and
+     * their pitch is the width of the Y plane.
+     *
+     * @return  row pitch in bytes
+     */
+    virtual int COR_CALL getPitch();
   };
 
 
@@ -274,6 +336,19 @@ namespace corona {
      * @return  current position
      */
     virtual int COR_CALL tell() = 0;
+
+    /**
+     * Get the whole file as one block of memory, if that is how it is
+     * stored, so loaders can parse it in place instead of copying it
+     * out with read().  The pointer stays valid until the file is
+     * written to or destroyed.  Files that aren't in memory don't need
+     * to override this.
+     *
+     * @param size  receives the size of the file in bytes
+     *
+     * @return  the file's contents, or 0 if they aren't in memory
+     */
+    virtual const void* COR_CALL getContents(int* size);
   };
 
 
@@ -297,6 +372,149 @@ namespace corona {
   };
 
 
+  /**
+   * What GetImageInfo() learns about an image file from its header.
+   * The pixel and palette formats are the ones OpenImage() would
+   * return the image in if no particular pixel format were requested.
+   */
+  struct ImageInfo {
+    int width;
+    int height;
+    PixelFormat format;
+    int palette_size;             ///< 0 if the image is not palettized
+    PixelFormat palette_format;   ///< PF_DONTCARE if not palettized
+    FileFormat file_format;       ///< never FF_AUTODETECT
+  };
+
+
+  /**
+   * Settings for OpenImage().  Options that don't apply to the file
+   * format being loaded are ignored, so other formats always come back
+   * at full size.  The defaults are what OpenImage() uses when no
+   * options are given.
+   */
+  struct OpenOptions {
+    OpenOptions()
+    : jpeg_scale_denominator(1)
+    , jpeg_min_width(0)
+    , jpeg_min_height(0)
+    , jpeg_ycbcr_planes(false)
+    {
+    }
+
+    /// Decodes JPEGs at 1/2, 1/4, or 1/8 of their size, rounded up,
+    /// or 1 for full size.  The scaling is done in the inverse DCT,
+    /// which makes small thumbnails much faster to decode than the
+    /// whole image and takes a fraction of the memory.
+    int jpeg_scale_denominator;
+
+    /// If either is nonzero, JPEGs are scaled down as far as they can
+    /// be while staying at least this wide and high, instead of by
+    /// jpeg_scale_denominator.
+    int jpeg_min_width;
+    int jpeg_min_height;
+
+    /// Decodes YCbCr JPEGs into a planar format holding the file's own
+    /// Y, Cb, and Cr samples, skipping upsampling and color
+    /// conversion.  The format depends on the file's chroma
+    /// subsampling (and on the scaling, which can leave the chroma
+    /// full size).  Files that don't fit one of the planar formats,
+    /// such as greyscale JPEGs, are decoded as usual, so check the
+    /// image's format.
+    bool jpeg_ycbcr_planes;
+  };
+
+
+  /**
+   * Settings for SaveImage().  Options that don't apply to the file
+   * format being saved are ignored.  The defaults are what SaveImage()
+   * uses when no options are given.
+   */
+  struct SaveOptions {
+    SaveOptions()
+    : threads(1)
+    , png_compression_level(-1)
+    , png_strategy(CS_DEFAULT)
+    , png_filter(RF_ADAPTIVE)
+    , jpeg_quality(85)
+    , jpeg_subsampling(SS_420)
+    , jpeg_optimize_coding(false)
+    , jpeg_dct_method(DM_ISLOW)
+    , jpeg_restart_interval(0)
+    {
+    }
+
+    /// Number of threads the encoder may use.  Only PNGs of more than
+    /// about 128 KB of pixels are split up.  The output depends on the
+    /// image and the other options, but not on the number of threads,
+    /// as long as it is more than one.
+    int threads;
+
+    /// zlib level from 0 (store) to 9 (smallest), or -1 for zlib's
+    /// default of 6
+    int png_compression_level;
+
+    CompressionStrategy png_strategy;
+
+    /// filter applied to every row
+    RowFilter png_filter;
+
+    /// from 1 (smallest) to 100 (best)
+    int jpeg_quality;
+
+    /// ignored for planar images, which are saved with the
+    /// subsampling of their planes
+    ChromaSubsampling jpeg_subsampling;
+
+    /// Builds Huffman tables for the image instead of using the
+    /// standard ones.  Files are a few percent smaller, but take an
+    /// extra pass to encode.
+    bool jpeg_optimize_coding;
+
+    DCTMethod jpeg_dct_method;
+
+    /// number of MCUs between restart markers, or 0 for none
+    int jpeg_restart_interval;
+  };
+
+
+  /**
+   * Frees a buffer that was handed to Corona with WrapImage(), or
+   * that came from an allocator installed with SetAllocator().  When
+   * an image is destroyed, it is called once for the pixel buffer and
+   * once for the palette, if the image has one.
+   *
+   * The size and alignment let pooled allocators return the buffer
+   * without keeping their own header in front of it.  For buffers from
+   * the allocator they are exactly the values it was asked for.  For
+   * buffers given to WrapImage(), size is pitch times height (all the
+   * planes, for planar formats) or the palette size in bytes, and
+   * alignment is 1.
+   *
+   * @param buffer     buffer to free
+   * @param size       size of the buffer in bytes
+   * @param alignment  alignment the buffer was allocated with
+   * @param user_data  the value passed to WrapImage() or SetAllocator()
+   */
+  typedef void (COR_CALL *BufferDeleter)(
+    void* buffer,
+    int size,
+    int alignment,
+    void* user_data);
+
+  /**
+   * Allocates a pixel or palette buffer.  See SetAllocator().
+   *
+   * @param size       number of bytes to allocate
+   * @param alignment  required alignment of the buffer, a power of two
+   * @param user_data  the value passed to SetAllocator()
+   *
+   * @return  the new buffer, or 0 if it can't be allocated
+   */
+  typedef void* (COR_CALL *BufferAllocator)(
+    int size, int alignment, void* user_data);
+
+
   /// PRIVATE API - for internal use only
   namespace hidden {
 
@@ -330,6 +548,25 @@ namespace corona {
       int palette_size,
       PixelFormat palette_format);
 
+    COR_FUNCTION(Image*) CorWrapImage(
+      int width,
+      int height,
+      PixelFormat format,
+      void* pixels,
+      int pitch,
+      void* palette,
+      int palette_size,
+      PixelFormat palette_format,
+      BufferDeleter deleter,
+      void* user_data);
+
+    COR_FUNCTION(Image*) CorCreateSubImage(
+      Image* parent,
+      int x,
+      int y,
+      int width,
+      int height);
+
     COR_FUNCTION(Image*) CorCloneImage(
       Image* source,
       PixelFormat format);
@@ -344,6 +581,36 @@ namespace corona {
       File* file,
       FileFormat file_format);
 
+    COR_FUNCTION(Image*) CorOpenImageWithOptions(
+      const char* filename,
+      FileFormat file_format,
+      const OpenOptions* options);
+
+    COR_FUNCTION(Image*) CorOpenImageFromFileWithOptions(
+      File* file,
+      FileFormat file_format,
+      const OpenOptions* options);
+
+    COR_FUNCTION(bool) CorOpenImageInto(
+      const char* filename,
+      FileFormat file_format,
+      Image* target);
+
+    COR_FUNCTION(bool) CorOpenImageIntoFromFile(
+      File* file,
+      FileFormat file_format,
+      Image* target);
+
+    COR_FUNCTION(bool) CorGetImageInfo(
+      const char* filename,
+      FileFormat file_format,
+      ImageInfo* info);
+
+    COR_FUNCTION(bool) CorGetImageInfoFromFile(
+      File* file,
+      FileFormat file_format,
+      ImageInfo* info);
+
     // saving
 
     COR_FUNCTION(bool) CorSaveImage(
@@ -356,6 +623,18 @@ namespace corona {
       FileFormat file_format,
       Image* image);
 
+    COR_FUNCTION(bool) CorSaveImageWithOptions(
+      const char* filename,
+      FileFormat file_format,
+      Image* image,
+      const SaveOptions* options);
+
+    COR_FUNCTION(bool) CorSaveImageToFileWithOptions(
+      File* file,
+      FileFormat file_format,
+      Image* image,
+      const SaveOptions* options);
+
     // conversion
 
     COR_FUNCTION(Image*) CorConvertImage(
@@ -374,6 +653,16 @@ namespace corona {
 
     COR_FUNCTION(File*) CorOpenFile(const char* name, bool writeable);
     COR_FUNCTION(File*) CorCreateMemoryFile(const void* buffer, int size);
+    COR_FUNCTION(File*) CorCreateReadOnlyMemoryFile(
+      const void* buffer,
+      int size);
+
+    // memory
+
+    COR_FUNCTION(void) CorSetAllocator(
+      BufferAllocator allocate,
+      BufferDeleter free,
+      void* user_data);
 
     // utility
 
@@ -419,7 +708,8 @@ namespace corona {
    * the contents of the image.  Corona does *not* take ownership of
    * the pixel memory, so the caller is responsible for cleaning up
    * after itself.  If pixels is not specified, the new image is
-   * filled with zeroes.
+   * filled with zeroes.  Planar images get a buffer for all of their
+   * planes.
    *
    * @param width   width of the new image
    * @param height  height of the new image
@@ -459,6 +749,113 @@ namespace corona {
       palette_size, palette_format);
   }
 
+  /**
+   * Create an image object around an existing pixel buffer without
+   * copying it.  The buffer must hold height rows of width pixels in
+   * the given format, each row starting pitch bytes after the last.
+   *
+   * If deleter is specified, the image takes ownership of the buffer
+   * and passes it to deleter when it is destroyed (see BufferDeleter
+   * for the size it reports).  If deleter is 0, the buffer still
+   * belongs to the caller and must outlive the image.  If the image
+   * can't be created, WrapImage returns 0 and never calls deleter.
+   *
+   * @param width      width of the image
+   * @param height     height of the image
+   * @param format     format the pixels are stored in, must be direct
+   *                   color or planar
+   * @param pixels     pixel buffer
+   * @param deleter    called to free the buffer, or 0 to leave it alone
+   * @param user_data  passed to deleter
+   * @param pitch      bytes from the start of one row to the next, or 0
+   *                   if the rows are tightly packed, as they must be
+   *                   for planar images
+   *
+   * @return  new image that uses the buffer, 0 if failure
+   */
+  inline Image* WrapImage(
+    int width,
+    int height,
+    PixelFormat format,
+    void* pixels,
+    BufferDeleter deleter = 0,
+    void* user_data = 0,
+    int pitch = 0)
+  {
+    return hidden::CorWrapImage(
+      width, height, format, pixels, pitch,
+      0, 0, PF_DONTCARE,
+      deleter, user_data);
+  }
+
+  /**
+   * Create a palettized image object around existing index and
+   * palette buffers without copying them.  Ownership works as in
+   * WrapImage(width, height, format, pixels, deleter, user_data):
+   * deleter is called for both buffers.
+   *
+   * @param width           width of the image
+   * @param height          height of the image
+   * @param format          format of palette indices, should be PF_I8
+   * @param pixels          index buffer
+   * @param palette         palette buffer
+   * @param palette_size    number of colors in palette
+   * @param palette_format  pixel format of palette entries
+   * @param deleter         called to free the buffers, or 0 to leave
+   *                        them alone
+   * @param user_data       passed to deleter
+   * @param pitch           bytes from the start of one row to the next,
+   *                        or 0 if the rows are tightly packed
+   *
+   * @return  new image that uses the buffers, 0 if failure
+   */
+  inline Image* WrapImage(
+    int width,
+    int height,
+    PixelFormat format,
+    void* pixels,
+    void* palette,
+    int palette_size,
+    PixelFormat palette_format,
+    BufferDeleter deleter = 0,
+    void* user_data = 0,
+    int pitch = 0)
+  {
+    return hidden::CorWrapImage(
+      width, height, format, pixels, pitch,
+      palette, palette_size, palette_format,
+      deleter, user_data);
+  }
+
+  /**
+   * Create a view of a rectangle inside another image.  The view
+   * doesn't copy anything: its pixels are the parent's pixels,
+   * reached through the parent's pitch, and it shares the parent's
+   * palette.  It can be saved, cloned, and converted like any other
+   * image, and touches nothing outside the rectangle.
+   *
+   * The view must be destroyed before the parent.  Converting the view
+   * creates a new image and leaves the parent alone, but FlipImage
+   * flips the rectangle inside the parent.
+   *
+   * @param parent  image to look into
+   * @param x       left edge of the rectangle
+   * @param y       top edge of the rectangle
+   * @param width   width of the rectangle
+   * @param height  height of the rectangle
+   *
+   * @return  new view of the parent, 0 if the rectangle isn't inside it
+   */
+  inline Image* CreateSubImage(
+    Image* parent,
+    int x,
+    int y,
+    int width,
+    int height)
+  {
+    return hidden::CorCreateSubImage(parent, x, y, width, height);
+  }
+
   /**
    * Create a new image from an old one.  If format is specified, the
    * new image is converted to that pixel format.  If format is not
@@ -543,6 +940,63 @@ namespace corona {
       pixel_format);
   }
 
+  /**
+   * Like OpenImage(filename, pixel_format, file_format), but with
+   * control over how the image is decoded.
+   *
+   * @param filename      image filename to open
+   * @param options       decoder settings
+   * @param pixel_format  desired pixel format, or PF_DONTCARE to use image's
+   *                      native format
+   * @param file_format   image's file format, or FF_AUTODETECT
+   *
+   * @return  the opened image, or 0 on failure
+   */
+  inline Image* OpenImage(
+    const char* filename,
+    const OpenOptions& options,
+    PixelFormat pixel_format = PF_DONTCARE,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    return hidden::CorConvertImage(
+      hidden::CorOpenImageWithOptions(filename, file_format, &options),
+      pixel_format);
+  }
+
+  /// For convenience.  Accepts a std::string.
+  inline Image* OpenImage(
+    const std::string& filename,
+    const OpenOptions& options,
+    PixelFormat pixel_format = PF_DONTCARE,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    return OpenImage(filename.c_str(), options, pixel_format, file_format);
+  }
+
+  /**
+   * Like OpenImage(file, pixel_format, file_format), but with control
+   * over how the image is decoded.
+   *
+   * @param file          file that contains the image
+   * @param options       decoder settings
+   * @param pixel_format  desired pixel format, or PF_DONTCARE to use image's
+   *                      native format
+   * @param file_format   file format the image is stored in, or FF_AUTODETECT
+   *                      to try all loaders
+   *
+   * @return  the image loaded from the file, or 0 if it cannot be opened
+   */
+  inline Image* OpenImage(
+    File* file,
+    const OpenOptions& options,
+    PixelFormat pixel_format = PF_DONTCARE,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    return hidden::CorConvertImage(
+      hidden::CorOpenImageFromFileWithOptions(file, file_format, &options),
+      pixel_format);
+  }
+
   /// For compatibility.  This function may be deprecated.
   inline Image* OpenImage(
     const char* filename,
@@ -561,6 +1015,118 @@ namespace corona {
     return OpenImage(file, pixel_format, file_format);
   }
 
+  /**
+   * Opens an image from the default filesystem into an existing image.
+   * See OpenImageInto(file, target, file_format).
+   *
+   * @param filename     image filename to open
+   * @param target       image to decode into
+   * @param file_format  file format the image is stored in, or
+   *                     FF_AUTODETECT to try all loaders
+   *
+   * @return  true on success, false otherwise
+   */
+  inline bool OpenImageInto(
+    const char* filename,
+    Image* target,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    return hidden::CorOpenImageInto(filename, file_format, target);
+  }
+
+  /// For convenience.  Accepts a std::string.
+  inline bool OpenImageInto(
+    const std::string& filename,
+    Image* target,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    return OpenImageInto(filename.c_str(), target, file_format);
+  }
+
+  /**
+   * Decodes an image file into the pixels of an existing image, such
+   * as one made with WrapImage() around a buffer that is reused from
+   * frame to frame.  The target must be direct color and exactly as
+   * big as the image in the file.  Pixels are converted to the
+   * target's format and written with its pitch.
+   *
+   * PNG and JPEG files are converted straight into the target, row by
+   * row, without allocating an image.  Other formats are decoded and
+   * then converted.
+   *
+   * If decoding fails, the target's pixels may have been partly
+   * overwritten.
+   *
+   * @param file         file that contains the image
+   * @param target       image to decode into
+   * @param file_format  file format the image is stored in, or
+   *                     FF_AUTODETECT to try all loaders
+   *
+   * @return  true on success, false if the file can't be decoded or
+   *          doesn't match the target's dimensions
+   */
+  inline bool OpenImageInto(
+    File* file,
+    Image* target,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    return hidden::CorOpenImageIntoFromFile(file, file_format, target);
+  }
+
+  /**
+   * Reads the header of an image file in the default filesystem.  See
+   * GetImageInfo(file, info, file_format).
+   *
+   * @param filename     image filename to probe
+   * @param info         receives the image's description
+   * @param file_format  file format the image is stored in, or
+   *                     FF_AUTODETECT to try all loaders
+   *
+   * @return  true on success, false otherwise
+   */
+  inline bool GetImageInfo(
+    const char* filename,
+    ImageInfo* info,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    return hidden::CorGetImageInfo(filename, file_format, info);
+  }
+
+  /// For convenience.  Accepts a std::string.
+  inline bool GetImageInfo(
+    const std::string& filename,
+    ImageInfo* info,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    return GetImageInfo(filename.c_str(), info, file_format);
+  }
+
+  /**
+   * Finds out the size and format of an image without decoding it.
+   * Only the header is read: the PNG IHDR and palette chunks, the
+   * JPEG frame header, the GIF screen descriptor, or the fixed-size
+   * BMP, TGA and PCX headers.  This is much cheaper than OpenImage(),
+   * and lets a caller allocate a buffer for OpenImageInto().
+   *
+   * A file that GetImageInfo() accepts may still turn out to be
+   * corrupt when it is opened.
+   *
+   * @param file         file that contains the image
+   * @param info         receives the image's description
+   * @param file_format  file format the image is stored in, or
+   *                     FF_AUTODETECT to try all loaders
+   *
+   * @return  true if the header is valid and describes an image that
+   *          Corona can open, false otherwise
+   */
+  inline bool GetImageInfo(
+    File* file,
+    ImageInfo* info,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    return hidden::CorGetImageInfoFromFile(file, file_format, info);
+  }
+
   /**
    * Saves an image to a file in the default filesystem.  This
    * function simply calls SaveImage(file, file_format, image)
@@ -617,14 +1183,84 @@ namespace corona {
     return hidden::CorSaveImageToFile(file, file_format, image);
   }
 
+  /**
+   * Like SaveImage(filename, file_format, image), but with control
+   * over how the image is encoded.
+   *
+   * @param filename     name of the file to save the image to
+   * @param file_format  file format in which to save image.  if FF_AUTODETECT,
+   *                     SaveImage guesses the type from the file extension
+   * @param image        image to save
+   * @param options      encoder settings
+   *
+   * @return  true if save succeeds, false otherwise
+   */
+  inline bool SaveImage(
+    const char* filename,
+    FileFormat file_format,
+    Image* image,
+    const SaveOptions& options)
+  {
+    return hidden::CorSaveImageWithOptions(
+      filename, file_format, image, &options);
+  }
+
+  /// For convenience.  Accepts a std::string.
+  inline bool SaveImage(
+    const std::string& filename,
+    FileFormat file_format,
+    Image* image,
+    const SaveOptions& options)
+  {
+    return SaveImage(filename.c_str(), file_format, image, options);
+  }
+
+  /**
+   * Like SaveImage(file, file_format, image), but with control over
+   * how the image is encoded.
+   *
+   * @param file         file in which to save the image
+   * @param file_format  file format in which to save image -- must not be
+   *                     FF_AUTODETECT
+   * @param image        image to save
+   * @param options      encoder settings
+   *
+   * @return  true if the save succeeds, false otherwise
+   */
+  inline bool SaveImage(
+    File* file,
+    FileFormat file_format,
+    Image* image,
+    const SaveOptions& options)
+  {
+    return hidden::CorSaveImageToFileWithOptions(
+      file, file_format, image, &options);
+  }
+
+  /**
+   * Returns SaveOptions for saving quickly at the cost of somewhat
+   * larger files, such as for screenshots.  PNGs save about four times
+   * as fast and come out 15-35% bigger.  JPEGs use the fast integer
+   * DCT.
+   */
+  inline SaveOptions FastSaveOptions() {
+    SaveOptions options;
+    options.png_compression_level = 1;
+    options.png_filter = RF_SUB;
+    options.jpeg_dct_method = DM_IFAST;
+    return options;
+  }
+
   /**
    * Converts an image from one format to another, destroying the old
    * image.  If source is 0, the function returns 0.  If format is
    * PF_DONTCARE or the source and target formats match, returns the
-   * unmodified source image.  If a valid conversion is not found,
-   * ConvertImage destroys the old image and returns 0.  For example,
-   * ConvertImage does not support creating a palettized image from a
-   * direct color image yet.
+   * unmodified source image.  Images created by Corona may be
+   * converted in place when the pixel size does not change, in which
+   * case the source object is returned.  If a valid conversion is not
+   * found, ConvertImage destroys the old image and returns 0.  For
+   * example, ConvertImage does not support creating a palettized
+   * image from a direct color image yet.
    *
    * @param source  image to convert
    * @param format  desired format -- can be PF_DONTCARE
@@ -654,7 +1290,8 @@ namespace corona {
   }
 
   /**
-   * Flips the pixels in the image around the given axis.
+   * Flips the pixels in the image around the given axis.  Planar
+   * images are flipped one plane at a time.
    *
    * @param source           image to flip
    * @param coordinate_axis  Axis around which to flip.  Both CA_X and CA_Y
@@ -667,7 +1304,9 @@ namespace corona {
   }
 
   /**
-   * Returns a default File implementation.
+   * Returns a default File implementation.  Files opened for reading
+   * are memory-mapped where the platform allows it, so their
+   * getContents() returns the mapping.
    *
    * @param  filename   name of the file on local filesystem
    * @param  writeable  whether the file can be written to
@@ -683,6 +1322,10 @@ namespace corona {
    * The File object does <i>not</i> take ownership of the memory buffer.
    * When the file is destroyed, it will not free the memory.
    *
+   * The file grows as it is written to.  Its getContents() returns
+   * everything in it, so an image saved to a memory file can be used
+   * without reading it back out.
+   *
    * @param buffer  Pointer to the beginning of the data.
    * @param size    Size of the buffer in bytes.
    *
@@ -693,6 +1336,46 @@ namespace corona {
     return hidden::CorCreateMemoryFile(buffer, size);
   }
 
+  /**
+   * Creates a File that reads a buffer in memory in place, without
+   * copying it.  The buffer must stay valid and unchanged until the
+   * file is destroyed, and the file can't be written to.  Loaders
+   * that support it (see File::getContents()) parse the buffer
+   * directly.
+   *
+   * @param buffer  Pointer to the beginning of the data.
+   * @param size    Size of the buffer in bytes.
+   *
+   * @return  0 if size is negative, or non-zero and buffer is null.
+   *          Otherwise, returns a valid File object.
+   */
+  inline File* CreateReadOnlyMemoryFile(const void* buffer, int size) {
+    return hidden::CorCreateReadOnlyMemoryFile(buffer, size);
+  }
+
+  /**
+   * Replaces the allocator Corona uses for every pixel and palette
+   * buffer it creates, from the decoders, the converters, and
+   * CreateImage and CloneImage alike.  Passing 0 for either function
+   * restores the default allocator.  Buffers are requested with
+   * 64-byte alignment.
+   *
+   * Images remember the free function that goes with their buffers,
+   * so the allocator can be changed while images are alive.  It must
+   * not be changed while another thread is using Corona.
+   *
+   * @param allocate   allocates buffers
+   * @param free       frees buffers from allocate
+   * @param user_data  passed to both functions
+   */
+  inline void SetAllocator(
+    BufferAllocator allocate,
+    BufferDeleter free,
+    void* user_data = 0)
+  {
+    hidden::CorSetAllocator(allocate, free, user_data);
+  }
+
   /**
    * Returns the number of bytes needed to store a pixel of a gixen format.
    *
@@ -704,6 +1387,11 @@ namespace corona {
     return hidden::CorGetPixelSize(format);
   }
 
+  /// By default, files are not in memory.
+  inline const void* COR_CALL File::getContents(int* /*size*/) {
+    return 0;
+  }
+
   /**
    * Returns true if the pixel format does not require a palette; that
    * is, if each pixel itself contains color data.
@@ -714,7 +1402,8 @@ namespace corona {
    */
   inline bool IsDirect(PixelFormat format) {
     return (format == PF_R8G8B8A8 || format == PF_R8G8B8 ||
-            format == PF_B8G8R8A8 || format == PF_B8G8R8);
+            format == PF_B8G8R8A8 || format == PF_B8G8R8 ||
+            format == PF_L8       || format == PF_L8A8);
   }
 
   /**
@@ -741,6 +1430,91 @@ namespace corona {
     return (format == PF_I8 ? 256 : 0);
   }
 
+  /**
+   * Returns true if the pixel format stores each component in a plane
+   * of its own.  The Y, Cb, and Cr planes of a planar image follow
+   * each other in its pixel buffer, each with tightly packed rows.  The
+   * chroma planes can be smaller than the image: see GetPlaneWidth()
+   * and GetPlaneHeight().  Planar formats have no pixel size, and
+   * images can't be converted to or from them.
+   *
+   * @param format  The format to query.
+   *
+   * @return  True if format is planar, false otherwise.
+   */
+  inline bool IsPlanar(PixelFormat format) {
+    return (format == PF_YCbCr444 || format == PF_YCbCr422 ||
+            format == PF_YCbCr420);
+  }
+
+  /**
+   * Returns the width of one plane of a planar image.
+   *
+   * @param format  The planar format.
+   * @param width   Width of the image.
+   * @param plane   0 for Y, 1 for Cb, 2 for Cr.
+   *
+   * @return  Number of samples in each row of the plane.
+   */
+  inline int GetPlaneWidth(PixelFormat format, int width, int plane) {
+    return (plane > 0 && format != PF_YCbCr444 ? (width + 1) / 2 : width);
+  }
+
+  /**
+   * Returns the height of one plane of a planar image.
+   *
+   * @param format  The planar format.
+   * @param height  Height of the image.
+   * @param plane   0 for Y, 1 for Cb, 2 for Cr.
+   *
+   * @return  Number of rows in the plane.
+   */
+  inline int GetPlaneHeight(PixelFormat format, int height, int plane) {
+    return (plane > 0 && format == PF_YCbCr420 ? (height + 1) / 2 : height);
+  }
+
+  /**
+   * Returns where a plane starts in the pixel buffer of a planar
+   * image.  Plane 3 is just past the end of the Cr plane, so its
+   * offset is the size of the whole buffer.
+   *
+   * @param format  The planar format.
+   * @param width   Width of the image.
+   * @param height  Height of the image.
+   * @param plane   0 for Y, 1 for Cb, 2 for Cr, or 3.
+   *
+   * @return  Offset of the plane in bytes.
+   */
+  inline int GetPlaneOffset(PixelFormat format, int width, int height,
+                            int plane) {
+    int offset = 0;
+    for (int i = 0; i < plane; ++i) {
+      offset += GetPlaneWidth(format, width, i) *
+                GetPlaneHeight(format, height, i);
+    }
+    return offset;
+  }
+
+  /**
+   * Returns the first sample of one plane of a planar image.
+   *
+   * @param image  The planar image.
+   * @param plane  0 for Y, 1 for Cb, 2 for Cr.
+   *
+   * @return  Pointer to the plane's first row.
+   */
+  inline void* GetPlane(Image* image, int plane) {
+    return (unsigned char*)image->getPixels() +
+      GetPlaneOffset(image->getFormat(), image->getWidth(),
+                     image->getHeight(), plane);
+  }
+
+  /// The default pitch: rows are tightly packed.
+  inline int COR_CALL Image::getPitch() {
+    const PixelFormat format = getFormat();
+    return getWidth() * (IsPlanar(format) ? 1 : GetPixelSize(format));
+  }
+
 }
 
 
@@ -0,0 +1,356 @@
+
+/* filter_sse2_intrinsics.c - SSE2 and SSSE3 row unfiltering for x86
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * Vectorized versions of the Up, Sub, Average and Paeth row unfilters in
+ * pngrutil.c, for 3- and 4-byte pixels (Up works for any pixel size).
+ * png_init_filter_functions_sse2() installs them only if the processor
+ * supports the instructions, so the scalar code remains the fallback.
+ *
+ * Sub, Average and Paeth depend on the pixel to the left, so only the
+ * bytes within a pixel are processed in parallel.  Up has no such
+ * dependency and is done 16 bytes at a time.
+ */
+
+#include "pngpriv.h"
+
+#ifdef PNG_INTEL_SSE
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+/* gcc and clang only emit the instructions enabled on the command line,
+ * unless a function asks for more.
+ */
+#ifdef __GNUC__
+#  define PNG_TARGET_SSE2  __attribute__((target("sse2")))
+#  define PNG_TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#  define PNG_TARGET_SSE2
+#  define PNG_TARGET_SSSE3
+#endif
+
+/* Loads and stores of 3 and 4 bytes, which may be unaligned.  memcpy()
+ * compiles to a single move.
+ */
+static PNG_TARGET_SSE2 __m128i
+load4(const void* p)
+{
+   int tmp;
+   memcpy(&tmp, p, sizeof(tmp));
+   return _mm_cvtsi32_si128(tmp);
+}
+
+static PNG_TARGET_SSE2 void
+store4(void* p, __m128i v)
+{
+   int tmp = _mm_cvtsi128_si32(v);
+   memcpy(p, &tmp, sizeof(tmp));
+}
+
+static PNG_TARGET_SSE2 __m128i
+load3(const void* p)
+{
+   png_uint_32 tmp = 0;
+   memcpy(&tmp, p, 3);
+   return _mm_cvtsi32_si128((int)tmp);
+}
+
+static PNG_TARGET_SSE2 void
+store3(void* p, __m128i v)
+{
+   int tmp = _mm_cvtsi128_si32(v);
+   memcpy(p, &tmp, 3);
+}
+
+static PNG_TARGET_SSE2 void
+png_read_filter_row_up_sse2(png_row_infop row_info, png_bytep row,
+   png_const_bytep prev)
+{
+   png_size_t rb = row_info->rowbytes;
+
+   while (rb >= 16)
+   {
+      __m128i b = _mm_loadu_si128((const __m128i*)prev);
+      __m128i x = _mm_loadu_si128((const __m128i*)row);
+      _mm_storeu_si128((__m128i*)row, _mm_add_epi8(x, b));
+
+      prev += 16;
+      row  += 16;
+      rb   -= 16;
+   }
+
+   while (rb > 0)
+   {
+      *row = (png_byte)(*row + *prev++);
+      row++;
+      rb--;
+   }
+}
+
+static PNG_TARGET_SSE2 void
+png_read_filter_row_sub3_sse2(png_row_infop row_info, png_bytep row,
+   png_const_bytep prev)
+{
+   /* The first pixel has no pixel to its left, which works out the same as
+    * a left pixel of zero.
+    */
+   png_size_t rb = row_info->rowbytes;
+   __m128i a, d = _mm_setzero_si128();
+
+   PNG_UNUSED(prev)
+
+   /* 4-byte loads are safe until the last pixel */
+   while (rb >= 4)
+   {
+      a = d; d = load4(row);
+      d = _mm_add_epi8(d, a);
+      store3(row, d);
+
+      row += 3;
+      rb  -= 3;
+   }
+   if (rb > 0)
+   {
+      a = d; d = load3(row);
+      d = _mm_add_epi8(d, a);
+      store3(row, d);
+   }
+}
+
+static PNG_TARGET_SSE2 void
+png_read_filter_row_sub4_sse2(png_row_infop row_info, png_bytep row,
+   png_const_bytep prev)
+{
+   png_size_t rb = row_info->rowbytes;
+   __m128i a, d = _mm_setzero_si128();
+
+   PNG_UNUSED(prev)
+
+   while (rb > 0)
+   {
+      a = d; d = load4(row);
+      d = _mm_add_epi8(d, a);
+      store4(row, d);
+
+      row += 4;
+      rb  -= 4;
+   }
+}
+
+/* PNG's average rounds down, but _mm_avg_epu8 rounds up.  Subtract the
+ * low bit of a^b, which is set exactly when a+b is odd.
+ */
+static PNG_TARGET_SSE2 __m128i
+average(__m128i a, __m128i b)
+{
+   __m128i avg = _mm_avg_epu8(a, b);
+   return _mm_sub_epi8(avg,
+      _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+static PNG_TARGET_SSE2 void
+png_read_filter_row_avg3_sse2(png_row_infop row_info, png_bytep row,
+   png_const_bytep prev)
+{
+   png_size_t rb = row_info->rowbytes;
+   __m128i a, b, d = _mm_setzero_si128();
+
+   while (rb >= 4)
+   {
+      b = load4(prev);
+      a = d; d = load4(row);
+      d = _mm_add_epi8(d, average(a, b));
+      store3(row, d);
+
+      prev += 3;
+      row  += 3;
+      rb   -= 3;
+   }
+   if (rb > 0)
+   {
+      b = load3(prev);
+      a = d; d = load3(row);
+      d = _mm_add_epi8(d, average(a, b));
+      store3(row, d);
+   }
+}
+
+static PNG_TARGET_SSE2 void
+png_read_filter_row_avg4_sse2(png_row_infop row_info, png_bytep row,
+   png_const_bytep prev)
+{
+   png_size_t rb = row_info->rowbytes;
+   __m128i a, b, d = _mm_setzero_si128();
+
+   while (rb > 0)
+   {
+      b = load4(prev);
+      a = d; d = load4(row);
+      d = _mm_add_epi8(d, average(a, b));
+      store4(row, d);
+
+      prev += 4;
+      row  += 4;
+      rb   -= 4;
+   }
+}
+
+/* Paeth works on 16-bit lanes, since the predictor distances can be
+ * negative and as large as 510.
+ */
+static PNG_TARGET_SSE2 __m128i
+if_then_else(__m128i c, __m128i t, __m128i e)
+{
+   return _mm_or_si128(_mm_and_si128(c, t), _mm_andnot_si128(c, e));
+}
+
+static PNG_TARGET_SSE2 __m128i
+abs_i16_sse2(__m128i x)
+{
+   /* flip the bits of negative lanes and add one */
+   __m128i is_negative = _mm_cmplt_epi16(x, _mm_setzero_si128());
+   x = _mm_xor_si128(x, is_negative);
+   return _mm_sub_epi16(x, is_negative);
+}
+
+static PNG_TARGET_SSSE3 __m128i
+abs_i16_ssse3(__m128i x)
+{
+   return _mm_abs_epi16(x);
+}
+
+/* Given the widened pixels to the left (a), above (b) and above-left (c),
+ * returns the one closest to a+b-c, breaking ties in favor of a, then b.
+ * ABS is the absolute value function to use.
+ */
+#define PNG_PAETH_PREDICTOR(ABS, a, b, c, nearest)                          \
+   {                                                                        \
+      /* p-a == b-c, p-b == a-c, and p-c == (b-c)+(a-c) */                  \
+      __m128i pa = _mm_sub_epi16(b, c);                                     \
+      __m128i pb = _mm_sub_epi16(a, c);                                     \
+      __m128i pc = _mm_add_epi16(pa, pb);                                   \
+      __m128i smallest;                                                     \
+                                                                            \
+      pa = ABS(pa);                                                         \
+      pb = ABS(pb);                                                         \
+      pc = ABS(pc);                                                         \
+      smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));                  \
+      nearest = if_then_else(_mm_cmpeq_epi16(smallest, pa), a,              \
+                if_then_else(_mm_cmpeq_epi16(smallest, pb), b, c));         \
+   }
+
+/* Defines a Paeth unfilter for BPP-byte pixels using ABS.  The pixels are
+ * kept widened to 16 bits; adding with _epi8 makes the low byte wrap
+ * modulo 256 while the high byte stays zero.
+ */
+#define PNG_PAETH_FILTER(NAME, TARGET, ABS, BPP)                            \
+static TARGET void                                                          \
+NAME(png_row_infop row_info, png_bytep row, png_const_bytep prev)           \
+{                                                                           \
+   png_size_t rb = row_info->rowbytes;                                      \
+   const __m128i zero = _mm_setzero_si128();                                \
+   __m128i a, b = zero, c, d = zero, nearest;                               \
+                                                                            \
+   while (rb >= 4)                                                          \
+   {                                                                        \
+      c = b; b = _mm_unpacklo_epi8(load4(prev), zero);                      \
+      a = d; d = _mm_unpacklo_epi8(load4(row), zero);                       \
+      PNG_PAETH_PREDICTOR(ABS, a, b, c, nearest)                            \
+      d = _mm_add_epi8(d, nearest);                                         \
+      if (BPP == 4)                                                         \
+         store4(row, _mm_packus_epi16(d, d));                               \
+      else                                                                  \
+         store3(row, _mm_packus_epi16(d, d));                               \
+                                                                            \
+      prev += BPP;                                                          \
+      row  += BPP;                                                          \
+      rb   -= BPP;                                                          \
+   }                                                                        \
+   if (rb > 0) /* the last 3-byte pixel */                                  \
+   {                                                                        \
+      c = b; b = _mm_unpacklo_epi8(load3(prev), zero);                      \
+      a = d; d = _mm_unpacklo_epi8(load3(row), zero);                       \
+      PNG_PAETH_PREDICTOR(ABS, a, b, c, nearest)                            \
+      d = _mm_add_epi8(d, nearest);                                         \
+      store3(row, _mm_packus_epi16(d, d));                                  \
+   }                                                                        \
+}
+
+PNG_PAETH_FILTER(png_read_filter_row_paeth3_sse2, PNG_TARGET_SSE2,
+   abs_i16_sse2, 3)
+PNG_PAETH_FILTER(png_read_filter_row_paeth4_sse2, PNG_TARGET_SSE2,
+   abs_i16_sse2, 4)
+PNG_PAETH_FILTER(png_read_filter_row_paeth3_ssse3, PNG_TARGET_SSSE3,
+   abs_i16_ssse3, 3)
+PNG_PAETH_FILTER(png_read_filter_row_paeth4_ssse3, PNG_TARGET_SSSE3,
+   abs_i16_ssse3, 4)
+
+#define PNG_CPU_SSE2  0x01
+#define PNG_CPU_SSSE3 0x02
+
+static int
+png_cpu_features(void)
+{
+   static int features = -1;
+
+   /* Racing threads compute the same answer, so no lock is needed. */
+   if (features == -1)
+   {
+      int found = 0;
+#ifdef __GNUC__
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("sse2"))
+         found |= PNG_CPU_SSE2;
+      if (__builtin_cpu_supports("ssse3"))
+         found |= PNG_CPU_SSSE3;
+#else
+      int info[4];
+      __cpuid(info, 1);
+      if (info[3] & (1 << 26))
+         found |= PNG_CPU_SSE2;
+      if (info[2] & (1 << 9))
+         found |= PNG_CPU_SSSE3;
+#endif
+      features = found;
+   }
+
+   return features;
+}
+
+void /* PRIVATE */
+png_init_filter_functions_sse2(png_structp pp, unsigned int bpp)
+{
+   int features = png_cpu_features();
+
+   if (!(features & PNG_CPU_SSE2))
+      return;
+
+   pp->read_filter[PNG_FILTER_VALUE_UP-1] = png_read_filter_row_up_sse2;
+
+   if (bpp == 3)
+   {
+      pp->read_filter[PNG_FILTER_VALUE_SUB-1] = png_read_filter_row_sub3_sse2;
+      pp->read_filter[PNG_FILTER_VALUE_AVG-1] = png_read_filter_row_avg3_sse2;
+      pp->read_filter[PNG_FILTER_VALUE_PAETH-1] =
+         (features & PNG_CPU_SSSE3) ? png_read_filter_row_paeth3_ssse3 :
+                                      png_read_filter_row_paeth3_sse2;
+   }
+
+   else if (bpp == 4)
+   {
+      pp->read_filter[PNG_FILTER_VALUE_SUB-1] = png_read_filter_row_sub4_sse2;
+      pp->read_filter[PNG_FILTER_VALUE_AVG-1] = png_read_filter_row_avg4_sse2;
+      pp->read_filter[PNG_FILTER_VALUE_PAETH-1] =
+         (features & PNG_CPU_SSSE3) ? png_read_filter_row_paeth4_ssse3 :
+                                      png_read_filter_row_paeth4_sse2;
+   }
+}
+
+#endif /* PNG_INTEL_SSE */
@@ -1011,6 +1011,26 @@ PNG_EXTERN void png_read_filter_row_paeth3_neon PNGARG((png_row_infop row_info,
 PNG_EXTERN void png_read_filter_row_paeth4_neon PNGARG((png_row_infop row_info,
     png_bytep row, png_const_bytep prev_row));
 
+/* SSE2 and SSSE3 unfilters (filter_sse2_intrinsics.c), for compilers that
+ * can target them from any function.  The processor is checked at runtime.
+ * Define PNG_NO_INTEL_SSE to leave them out.
+ */
+#if !defined(PNG_NO_INTEL_SSE) && !defined(PNG_INTEL_SSE)
+#  if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) && \
+      (defined(__clang__) || __GNUC__ > 4 || \
+       (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#    define PNG_INTEL_SSE
+#  elif defined(_MSC_VER) && _MSC_VER >= 1700 && \
+      (defined(_M_IX86) || defined(_M_X64))
+#    define PNG_INTEL_SSE
+#  endif
+#endif
+
+#ifdef PNG_INTEL_SSE
+PNG_EXTERN void png_init_filter_functions_sse2 PNGARG((png_structp pp,
+    unsigned int bpp));
+#endif
+
 /* Choose the best filter to use and filter the row data */
 PNG_EXTERN void png_write_find_filter PNGARG((png_structp png_ptr,
     png_row_infop row_info));
@@ -3738,6 +3738,10 @@ png_init_filter_functions(png_structp pp)
 #ifdef PNG_ARM_NEON
    png_init_filter_functions_neon(pp, bpp);
 #endif
+
+#ifdef PNG_INTEL_SSE
+   png_init_filter_functions_sse2(pp, bpp);
+#endif
 }
 
 void /* PRIVATE */
@@ -7,6 +7,8 @@
 
 #include "zlib.h"
 
+#define local static
+
 #define BASE 65521L /* largest prime smaller than 65536 */
 #define NMAX 5552
 /* NMAX is the largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1 */
@@ -17,6 +19,112 @@
 #define DO8(buf,i)  DO4(buf,i); DO4(buf,i+4);
 #define DO16(buf)   DO8(buf,0); DO8(buf,8);
 
+/* An SSSE3 version of the loop below is used when the processor has it.
+ * Define NO_INTEL_SSE to leave it out.
+ */
+#if !defined(NO_INTEL_SSE) && defined(__GNUC__) && \
+    (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#  define ADLER32_SSSE3
+#  define TARGET_SSSE3 __attribute__((target("ssse3")))
+#elif !defined(NO_INTEL_SSE) && defined(_MSC_VER) && _MSC_VER >= 1700 && \
+    (defined(_M_IX86) || defined(_M_X64))
+#  define ADLER32_SSSE3
+#  define TARGET_SSSE3
+#  include <intrin.h>
+#endif
+
+#ifdef ADLER32_SSSE3
+#include <tmmintrin.h>
+
+#define BLOCK_SIZE 32
+
+local int have_ssse3 OF((void));
+local uLong adler32_ssse3 OF((unsigned long s1, unsigned long s2,
+                              const Bytef **buf, uInt blocks));
+
+local int have_ssse3()
+{
+    static int ssse3 = -1;  /* threads racing here find the same answer */
+    if (ssse3 == -1) {
+#ifdef __GNUC__
+        __builtin_cpu_init();
+        ssse3 = __builtin_cpu_supports("ssse3") != 0;
+#else
+        int info[4];
+        __cpuid(info, 1);
+        ssse3 = (info[2] & (1 << 9)) != 0;
+#endif
+    }
+    return ssse3;
+}
+
+/* Sums blocks of BLOCK_SIZE bytes into s1 and s2 and returns the new
+   checksum.  Within a block, byte i is added into s2 BLOCK_SIZE - i
+   times, which pmaddubsw computes sixteen bytes at a time.  Every block
+   also adds BLOCK_SIZE copies of s1 as it was before the block; those
+   are tallied in ps and multiplied in at the end.  At most NMAX bytes
+   are summed between reductions, as in the scalar code. */
+local TARGET_SSSE3 uLong adler32_ssse3(s1, s2, buf, blocks)
+    unsigned long s1;
+    unsigned long s2;
+    const Bytef **buf;
+    uInt blocks;
+{
+    const Bytef *p = *buf;
+    const __m128i taps1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+                                        24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i taps2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+                                        8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    while (blocks) {
+        uInt n = NMAX / BLOCK_SIZE;
+        __m128i v_ps, v_s1, v_s2;
+        if (n > blocks) n = blocks;
+        blocks -= n;
+
+        v_ps = _mm_cvtsi32_si128((int)(s1 * n));
+        v_s1 = zero;
+        v_s2 = _mm_cvtsi32_si128((int)s2);
+        do {
+            const __m128i bytes1 = _mm_loadu_si128((const __m128i*)p);
+            const __m128i bytes2 = _mm_loadu_si128((const __m128i*)(p + 16));
+
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+                _mm_maddubs_epi16(bytes1, taps1), ones));
+
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+                _mm_maddubs_epi16(bytes2, taps2), ones));
+
+            p += BLOCK_SIZE;
+        } while (--n);
+
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+        /* add up the lanes */
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, 0x4e));
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, 0xb1));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, 0x4e));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, 0xb1));
+        s1 += (unsigned)_mm_cvtsi128_si32(v_s1);
+        s2 = (unsigned)_mm_cvtsi128_si32(v_s2);
+
+        s1 %= BASE;
+        s2 %= BASE;
+    }
+
+    *buf = p;
+    return (s2 << 16) | s1;
+}
+#endif /* ADLER32_SSSE3 */
+
 /* ========================================================================= */
 uLong ZEXPORT adler32(adler, buf, len)
     uLong adler;
@@ -29,6 +137,15 @@ uLong ZEXPORT adler32(adler, buf, len)
 
     if (buf == Z_NULL) return 1L;
 
+#ifdef ADLER32_SSSE3
+    if (len >= 2 * BLOCK_SIZE && have_ssse3()) {
+        uLong sum = adler32_ssse3(s1, s2, &buf, len / BLOCK_SIZE);
+        len %= BLOCK_SIZE;
+        s1 = sum & 0xffff;
+        s2 = sum >> 16;
+    }
+#endif
+
     while (len > 0) {
         k = len < NMAX ? len : NMAX;
         len -= k;
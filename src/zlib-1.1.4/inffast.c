@@ -16,9 +16,47 @@ struct inflate_codes_state {int dummy;}; /* for buggy compilers */
 #define exop word.what.Exop
 #define bits word.what.Bits
 
-/* macros for bit input with no checking and for returning unused bytes */
-#define GRABBITS(j) {while(k<(j)){b|=((uLong)NEXTBYTE)<<k;k+=8;}}
-#define UNGRAB {c=z->avail_in-n;c=(k>>3)<c?k>>3:c;n+=c;p-=c;k-=c<<3;}
+/* With a 64-bit bit buffer, one load at the top of the loop brings in
+   enough bits for a whole length/distance pair (at most 48), instead of
+   a byte at a time as they're needed.  The buffer is refilled with
+   whole bytes, so the bits above k are the next bytes of input; they
+   are cleared before the buffer is handed back to the slow decoder. */
+#if defined(_MSC_VER)
+   typedef unsigned __int64 bitbuf;
+#  define FAST_REFILL
+#elif defined(__GNUC__)
+   typedef unsigned long long bitbuf;
+#  define FAST_REFILL
+#else
+   typedef uLong bitbuf;
+#endif
+
+#ifdef FAST_REFILL
+#  if defined(_M_IX86) || defined(_M_X64) || \
+      defined(__i386__) || defined(__x86_64__) || \
+      (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#    define LOAD64(w) zmemcpy((Bytef*)&(w), p, 8)
+#  else
+#    define LOAD64(w) \
+       {w=(bitbuf)p[0]|((bitbuf)p[1]<<8)|((bitbuf)p[2]<<16)| \
+          ((bitbuf)p[3]<<24)|((bitbuf)p[4]<<32)|((bitbuf)p[5]<<40)| \
+          ((bitbuf)p[6]<<48)|((bitbuf)p[7]<<56);}
+#  endif
+   /* needs eight bytes of input, which the loop condition guarantees */
+#  define REFILL {bitbuf w;LOAD64(w);b|=w<<k;c=(63-k)>>3;p+=c;n-=c;k+=c<<3;}
+#  define GRABBITS(j)
+#  define CLEARHIGH {b&=((bitbuf)1<<k)-1;}
+#else
+#  define REFILL
+#  define GRABBITS(j) {while(k<(j)){b|=((uLong)NEXTBYTE)<<k;k+=8;}}
+#  define CLEARHIGH
+#endif
+
+/* macros for returning unused bytes */
+#define UNGRAB {c=z->avail_in-n;c=(k>>3)<c?k>>3:c;n+=c;p-=c;k-=c<<3;CLEARHIGH}
+
+/* Copies eight bytes, which must not overlap. */
+#define COPY8(q,r) zmemcpy(q,r,8)
 
 /* Called with number of bytes left to write in window at least 258
    (the maximum string length) and number of input bytes available
@@ -34,7 +72,7 @@ z_streamp z;
 {
   inflate_huft *t;      /* temporary pointer */
   uInt e;               /* extra bits or operation */
-  uLong b;              /* bit buffer */
+  bitbuf b;             /* bit buffer */
   uInt k;               /* bits in bit buffer */
   Bytef *p;             /* input data pointer */
   uInt n;               /* bytes available there */
@@ -56,6 +94,7 @@ z_streamp z;
   /* do until not enough input or output space for fast loop */
   do {                          /* assume called with m >= 258 && n >= 10 */
     /* get literal/length code */
+    REFILL
     GRABBITS(20)                /* max bits for literal/length code */
     if ((e = (t = tl + ((uInt)b & ml))->exop) == 0)
     {
@@ -120,13 +159,32 @@ z_streamp z;
                 } while (--c);
               }
             }
-            else                                /* normal copy */
+            else                                /* word copy */
             {
-              *q++ = *r++;  c--;
-              *q++ = *r++;  c--;
-              do {
+              /* The copy is done a word at a time, and the last few
+                 bytes one at a time.  Rounding up would write past the
+                 match, and once the window has wrapped the bytes there
+                 are the oldest history, still in reach of a distance
+                 of up to 32768.  If the source overlaps the first word,
+                 the match repeats every d bytes: copy a few bytes
+                 singly, then copy words from a multiple of d back that
+                 is at least eight. */
+              if (d < 8)
+              {
+                uInt dd = (7 / d + 1) * d;
+                e = dd - d < c ? dd - d : c;
+                c -= e;
+                while (e--)
+                  *q++ = *r++;
+                r = q - dd;
+              }
+              while (c >= 8)
+              {
+                COPY8(q, r);
+                q += 8;  r += 8;  c -= 8;
+              }
+              while (c--)
                 *q++ = *r++;
-              } while (--c);
             }
             break;
           }
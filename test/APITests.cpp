@@ -1,5 +1,6 @@
 #include <algorithm>
 #include "APITests.h"
+#include "Images.h"
 
 
 void
@@ -188,19 +189,27 @@ APITests::testFormatQueries() {
     CPPUNIT_ASSERT(GetPixelSize(PF_R8G8B8)   == 3);
     CPPUNIT_ASSERT(GetPixelSize(PF_B8G8R8)   == 3);
     CPPUNIT_ASSERT(GetPixelSize(PF_I8)       == 1);
+    CPPUNIT_ASSERT(GetPixelSize(PF_L8)       == 1);
+    CPPUNIT_ASSERT(GetPixelSize(PF_L8A8)     == 2);
+    CPPUNIT_ASSERT(GetPixelSize(PF_YCbCr420) == 0);
     CPPUNIT_ASSERT(GetPixelSize(PF_DONTCARE) == 0);
     
     CPPUNIT_ASSERT(IsDirect(PF_R8G8B8A8));
     CPPUNIT_ASSERT(IsDirect(PF_B8G8R8A8));
     CPPUNIT_ASSERT(IsDirect(PF_R8G8B8));
     CPPUNIT_ASSERT(IsDirect(PF_B8G8R8));
+    CPPUNIT_ASSERT(IsDirect(PF_L8));
+    CPPUNIT_ASSERT(IsDirect(PF_L8A8));
     CPPUNIT_ASSERT(!IsDirect(PF_I8));
+    CPPUNIT_ASSERT(!IsDirect(PF_YCbCr444));
     CPPUNIT_ASSERT(!IsDirect(PF_DONTCARE));
     
     CPPUNIT_ASSERT(!IsPalettized(PF_R8G8B8A8));
     CPPUNIT_ASSERT(!IsPalettized(PF_B8G8R8A8));
     CPPUNIT_ASSERT(!IsPalettized(PF_R8G8B8));
     CPPUNIT_ASSERT(!IsPalettized(PF_B8G8R8));
+    CPPUNIT_ASSERT(!IsPalettized(PF_L8));
+    CPPUNIT_ASSERT(!IsPalettized(PF_L8A8));
     CPPUNIT_ASSERT(IsPalettized(PF_I8));
     CPPUNIT_ASSERT(!IsPalettized(PF_DONTCARE));
 
@@ -208,8 +217,100 @@ APITests::testFormatQueries() {
     CPPUNIT_ASSERT(GetPaletteSize(PF_B8G8R8A8) == 0);
     CPPUNIT_ASSERT(GetPaletteSize(PF_R8G8B8)   == 0);
     CPPUNIT_ASSERT(GetPaletteSize(PF_B8G8R8)   == 0);
+    CPPUNIT_ASSERT(GetPaletteSize(PF_L8)       == 0);
+    CPPUNIT_ASSERT(GetPaletteSize(PF_L8A8)     == 0);
     CPPUNIT_ASSERT(GetPaletteSize(PF_I8)       == 256);
     CPPUNIT_ASSERT(GetPaletteSize(PF_DONTCARE) == 0);
+
+    CPPUNIT_ASSERT(IsPlanar(PF_YCbCr444));
+    CPPUNIT_ASSERT(IsPlanar(PF_YCbCr422));
+    CPPUNIT_ASSERT(IsPlanar(PF_YCbCr420));
+    CPPUNIT_ASSERT(!IsPlanar(PF_R8G8B8));
+    CPPUNIT_ASSERT(!IsPlanar(PF_L8));
+    CPPUNIT_ASSERT(!IsPlanar(PF_I8));
+    CPPUNIT_ASSERT(!IsPlanar(PF_DONTCARE));
+
+    CPPUNIT_ASSERT(GetPlaneWidth (PF_YCbCr444, 7, 0) == 7);
+    CPPUNIT_ASSERT(GetPlaneWidth (PF_YCbCr444, 7, 1) == 7);
+    CPPUNIT_ASSERT(GetPlaneHeight(PF_YCbCr444, 5, 2) == 5);
+    CPPUNIT_ASSERT(GetPlaneWidth (PF_YCbCr422, 7, 0) == 7);
+    CPPUNIT_ASSERT(GetPlaneWidth (PF_YCbCr422, 7, 1) == 4);
+    CPPUNIT_ASSERT(GetPlaneHeight(PF_YCbCr422, 5, 2) == 5);
+    CPPUNIT_ASSERT(GetPlaneWidth (PF_YCbCr420, 7, 2) == 4);
+    CPPUNIT_ASSERT(GetPlaneHeight(PF_YCbCr420, 5, 0) == 5);
+    CPPUNIT_ASSERT(GetPlaneHeight(PF_YCbCr420, 5, 1) == 3);
+
+    CPPUNIT_ASSERT(GetPlaneOffset(PF_YCbCr444, 7, 5, 3) == 7 * 5 * 3);
+    CPPUNIT_ASSERT(GetPlaneOffset(PF_YCbCr422, 7, 5, 2) == 35 + 4 * 5);
+    CPPUNIT_ASSERT(GetPlaneOffset(PF_YCbCr420, 7, 5, 1) == 35);
+    CPPUNIT_ASSERT(GetPlaneOffset(PF_YCbCr420, 7, 5, 3) == 35 + 2 * 4 * 3);
+}
+
+
+void
+APITests::testPlanarImages() {
+  const int width  = 7;
+  const int height = 5;
+  const int size = GetPlaneOffset(PF_YCbCr420, width, height, 3);
+
+  // new planar images have room for every plane, and are blank
+  auto_ptr<Image> image(CreateImage(width, height, PF_YCbCr420));
+  CPPUNIT_ASSERT(image.get() != 0);
+  CPPUNIT_ASSERT_EQUAL(width, image->getPitch());
+  const byte* pixels = (const byte*)image->getPixels();
+  for (int i = 0; i < size; ++i) {
+    CPPUNIT_ASSERT_EQUAL(0, int(pixels[i]));
+  }
+  CPPUNIT_ASSERT((byte*)GetPlane(image.get(), 0) == pixels);
+  CPPUNIT_ASSERT((byte*)GetPlane(image.get(), 2) == pixels + 35 + 12);
+
+  byte buffer[35 + 12 + 12];
+  for (int i = 0; i < size; ++i) {
+    buffer[i] = byte(i * 7);
+  }
+  image.reset(CreateImage(width, height, PF_YCbCr420, buffer));
+  CPPUNIT_ASSERT(image.get() != 0);
+  CPPUNIT_ASSERT(memcmp(image->getPixels(), buffer, size) == 0);
+
+  // they can be copied, but not converted
+  auto_ptr<Image> copy(CloneImage(image.get()));
+  CPPUNIT_ASSERT(copy.get() != 0);
+  CPPUNIT_ASSERT(copy->getFormat() == PF_YCbCr420);
+  CPPUNIT_ASSERT(copy->getPixels() != image->getPixels());
+  CPPUNIT_ASSERT(memcmp(copy->getPixels(), buffer, size) == 0);
+  copy.reset(CloneImage(image.get(), PF_YCbCr420));
+  CPPUNIT_ASSERT(copy.get() != 0);
+
+  CPPUNIT_ASSERT(CloneImage(image.get(), PF_R8G8B8) == 0);
+  CPPUNIT_ASSERT(CloneImage(image.get(), PF_YCbCr444) == 0);
+  CPPUNIT_ASSERT(CreateSubImage(image.get(), 1, 1, 2, 2) == 0);
+
+  // each plane is flipped on its own
+  CPPUNIT_ASSERT(FlipImage(copy.get(), CA_X | CA_Y) == copy.get());
+  const byte* flipped = (const byte*)copy->getPixels();
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      CPPUNIT_ASSERT_EQUAL(
+        int(buffer[(height - y - 1) * width + (width - x - 1)]),
+        int(flipped[y * width + x]));
+    }
+  }
+  for (int y = 0; y < 3; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      CPPUNIT_ASSERT_EQUAL(
+        int(buffer[35 + 12 + (2 - y) * 4 + (3 - x)]),
+        int(flipped[35 + 12 + y * 4 + x]));
+    }
+  }
+  FlipImage(copy.get(), CA_X | CA_Y);
+  CPPUNIT_ASSERT(memcmp(copy->getPixels(), buffer, size) == 0);
+
+  // wrapped planes must be tightly packed
+  auto_ptr<Image> wrapped(WrapImage(width, height, PF_YCbCr420, buffer));
+  CPPUNIT_ASSERT(wrapped.get() != 0);
+  CPPUNIT_ASSERT(GetPlane(wrapped.get(), 1) == buffer + 35);
+  CPPUNIT_ASSERT(WrapImage(width, height, PF_YCbCr420, buffer, 0, 0,
+                           width + 1) == 0);
 }
 
 
@@ -279,6 +380,407 @@ APITests::testMemory() {
 }
 
 
+/// Remembers the buffers WrapImage() hands back.
+struct DeleterLog {
+  int   calls;
+  void* last;
+  int   last_size;
+  int   last_alignment;
+};
+
+
+void COR_CALL LogDeletion(
+  void* buffer,
+  int size,
+  int alignment,
+  void* user_data)
+{
+  DeleterLog* log = (DeleterLog*)user_data;
+  ++log->calls;
+  log->last           = buffer;
+  log->last_size      = size;
+  log->last_alignment = alignment;
+}
+
+
+void
+APITests::testWrapImage() {
+  byte pixels[4 * 4 * 4];
+  for (int i = 0; i < 4 * 4 * 4; ++i) {
+    pixels[i] = i;
+  }
+
+  {
+    // non-owning: the image uses our buffer but never frees it
+    Image* image = WrapImage(4, 4, PF_R8G8B8A8, pixels);
+    CPPUNIT_ASSERT(image != 0);
+    CPPUNIT_ASSERT(image->getWidth()  == 4);
+    CPPUNIT_ASSERT(image->getHeight() == 4);
+    CPPUNIT_ASSERT(image->getFormat() == PF_R8G8B8A8);
+    CPPUNIT_ASSERT(image->getPixels() == pixels);
+
+    // converting must not scribble over a buffer we still own
+    auto_ptr<Image> converted(ConvertImage(image, PF_B8G8R8A8));
+    CPPUNIT_ASSERT(converted.get() != 0);
+    CPPUNIT_ASSERT(converted->getPixels() != pixels);
+    for (int i = 0; i < 4 * 4 * 4; ++i) {
+      CPPUNIT_ASSERT(pixels[i] == i);
+    }
+  }
+
+  {
+    // owning: the deleter gets the buffer back, with its size
+    DeleterLog log = { 0, 0, 0, 0 };
+    Image* image = WrapImage(4, 4, PF_R8G8B8A8, pixels, LogDeletion, &log);
+    CPPUNIT_ASSERT(image != 0);
+    CPPUNIT_ASSERT(log.calls == 0);
+    delete image;
+    CPPUNIT_ASSERT(log.calls == 1);
+    CPPUNIT_ASSERT(log.last == pixels);
+    CPPUNIT_ASSERT(log.last_size == 4 * 4 * 4);
+    CPPUNIT_ASSERT(log.last_alignment == 1);
+  }
+
+  {
+    // a padded buffer is pitch times height bytes
+    DeleterLog log = { 0, 0, 0, 0 };
+    Image* image = WrapImage(3, 4, PF_R8G8B8A8, pixels,
+                             LogDeletion, &log, 16);
+    CPPUNIT_ASSERT(image != 0);
+    delete image;
+    CPPUNIT_ASSERT(log.calls == 1);
+    CPPUNIT_ASSERT(log.last_size == 16 * 4);
+  }
+
+  {
+    // palettized: both buffers go to the deleter
+    byte palette[256 * 3];
+    memset(palette, 0, sizeof(palette));
+    DeleterLog log = { 0, 0, 0, 0 };
+    Image* image = WrapImage(4, 4, PF_I8, pixels,
+                             palette, 256, PF_R8G8B8, LogDeletion, &log);
+    CPPUNIT_ASSERT(image != 0);
+    CPPUNIT_ASSERT(image->getPalette() == palette);
+    delete image;
+    CPPUNIT_ASSERT(log.calls == 2);
+    CPPUNIT_ASSERT(log.last_size == 256 * 3);
+  }
+
+  {
+    // bad arguments fail without touching the deleter
+    DeleterLog log = { 0, 0, 0, 0 };
+    CPPUNIT_ASSERT(WrapImage(4, 4, PF_R8G8B8A8, 0, LogDeletion, &log) == 0);
+    CPPUNIT_ASSERT(WrapImage(4, 4, PF_I8, pixels, LogDeletion, &log) == 0);
+    CPPUNIT_ASSERT(WrapImage(4, 4, PF_DONTCARE, pixels,
+                             LogDeletion, &log) == 0);
+    CPPUNIT_ASSERT(log.calls == 0);
+  }
+}
+
+
+void
+APITests::testSubImage() {
+  const int width  = 10;
+  const int height = 8;
+  auto_ptr<Image> parent(CreateImage(width, height, PF_R8G8B8A8));
+  byte* pixels = (byte*)parent->getPixels();
+  for (int i = 0; i < width * height * 4; ++i) {
+    pixels[i] = byte(rand() % 256);
+  }
+  auto_ptr<Image> original(CloneImage(parent.get()));
+
+  const int x = 3;
+  const int y = 2;
+  auto_ptr<Image> view(CreateSubImage(parent.get(), x, y, 4, 5));
+  CPPUNIT_ASSERT(view.get() != 0);
+  CPPUNIT_ASSERT(view->getWidth()  == 4);
+  CPPUNIT_ASSERT(view->getHeight() == 5);
+  CPPUNIT_ASSERT(view->getFormat() == PF_R8G8B8A8);
+  CPPUNIT_ASSERT(view->getPitch()  == parent->getPitch());
+  CPPUNIT_ASSERT(view->getPixels() == pixels + (y * width + x) * 4);
+
+  // build the crop by hand
+  auto_ptr<Image> crop(CreateImage(4, 5, PF_R8G8B8A8));
+  for (int h = 0; h < 5; ++h) {
+    memcpy((byte*)crop->getPixels() + h * 4 * 4,
+           pixels + ((y + h) * width + x) * 4,
+           4 * 4);
+  }
+
+  auto_ptr<Image> cloned(CloneImage(view.get()));
+  AssertImagesEqual("cloned view", cloned.get(), crop.get());
+
+  // saving the view saves just the rectangle
+  auto_ptr<File> file(CreateMemoryFile(0, 0));
+  CPPUNIT_ASSERT(SaveImage(file.get(), FF_PNG, view.get()));
+  file->seek(0, File::BEGIN);
+  auto_ptr<Image> loaded(OpenImage(file.get(), FF_PNG));
+  CPPUNIT_ASSERT(loaded.get() != 0);
+  AssertImagesEqual("saved view", loaded.get(), crop.get());
+
+  // converting the view leaves the parent alone
+  auto_ptr<Image> converted(ConvertImage(view.release(), PF_B8G8R8A8));
+  CPPUNIT_ASSERT(converted.get() != 0);
+  AssertImagesEqual("parent", parent.get(), original.get());
+
+  // views of views
+  auto_ptr<Image> outer(CreateSubImage(parent.get(), 1, 1, 8, 6));
+  auto_ptr<Image> inner(CreateSubImage(outer.get(), x - 1, y - 1, 4, 5));
+  CPPUNIT_ASSERT(inner.get() != 0);
+  AssertImagesEqual("nested view", inner.get(), crop.get());
+
+  // palettized views share the palette
+  auto_ptr<Image> indexed(CreateImage(width, height, PF_I8, 256, PF_R8G8B8));
+  auto_ptr<Image> indexed_view(CreateSubImage(indexed.get(), 1, 1, 2, 2));
+  CPPUNIT_ASSERT(indexed_view.get() != 0);
+  CPPUNIT_ASSERT(indexed_view->getPalette() == indexed->getPalette());
+  CPPUNIT_ASSERT(indexed_view->getPaletteSize() == 256);
+  CPPUNIT_ASSERT(indexed_view->getPaletteFormat() == PF_R8G8B8);
+
+  // rectangles must fit inside the parent
+  CPPUNIT_ASSERT(CreateSubImage(0, 0, 0, 1, 1) == 0);
+  CPPUNIT_ASSERT(CreateSubImage(parent.get(), -1, 0, 1, 1) == 0);
+  CPPUNIT_ASSERT(CreateSubImage(parent.get(), 0, 0, width + 1, 1) == 0);
+  CPPUNIT_ASSERT(CreateSubImage(parent.get(), 0, 7, 1, 2) == 0);
+  auto_ptr<Image> whole(CreateSubImage(parent.get(), 0, 0, width, height));
+  CPPUNIT_ASSERT(whole.get() != 0);
+}
+
+
+/// Counts what goes through the allocator hook.
+struct AllocatorStats {
+  int allocations;
+  int frees;
+  bool misaligned;
+  bool mismatched;  // a buffer was freed with the wrong size
+};
+
+
+/// Kept just in front of every buffer from CountingAllocate.
+struct BlockHeader {
+  void* block;
+  int   size;
+  int   alignment;
+};
+
+
+void* COR_CALL CountingAllocate(int size, int alignment, void* user_data) {
+  AllocatorStats* stats = (AllocatorStats*)user_data;
+  ++stats->allocations;
+
+  byte* block = (byte*)malloc(size + alignment + sizeof(BlockHeader));
+  size_t start = size_t(block + sizeof(BlockHeader));
+  byte* buffer = (byte*)((start + alignment - 1) & ~size_t(alignment - 1));
+  BlockHeader* header = (BlockHeader*)buffer - 1;
+  header->block     = block;
+  header->size      = size;
+  header->alignment = alignment;
+  return buffer;
+}
+
+
+void COR_CALL CountingFree(
+  void* buffer,
+  int size,
+  int alignment,
+  void* user_data)
+{
+  AllocatorStats* stats = (AllocatorStats*)user_data;
+  ++stats->frees;
+
+  BlockHeader* header = (BlockHeader*)buffer - 1;
+  if (header->size != size || header->alignment != alignment) {
+    stats->mismatched = true;
+  }
+  free(header->block);
+}
+
+
+void
+APITests::testAllocator() {
+  AllocatorStats stats = { 0, 0, false, false };
+  SetAllocator(CountingAllocate, CountingFree, &stats);
+
+  // every decoder goes through the allocator
+  const int image_count = sizeof(ALL_IMAGES) / sizeof(*ALL_IMAGES);
+  for (int i = 0; i < image_count; ++i) {
+    auto_ptr<Image> image(OpenImage(ALL_IMAGES[i]));
+    if (image.get()) {
+      if (size_t(image->getPixels()) % 64 != 0 ||
+          (image->getPalette() && size_t(image->getPalette()) % 64 != 0))
+      {
+        stats.misaligned = true;
+      }
+
+      auto_ptr<Image> clone(CloneImage(image.get(), PF_B8G8R8));
+      CPPUNIT_ASSERT(clone.get() != 0);
+      CPPUNIT_ASSERT(size_t(clone->getPixels()) % 64 == 0);
+    }
+  }
+  CPPUNIT_ASSERT(!stats.misaligned);
+  CPPUNIT_ASSERT(!stats.mismatched);
+  CPPUNIT_ASSERT(stats.allocations > image_count);
+  CPPUNIT_ASSERT(stats.allocations == stats.frees);
+
+  // images free their buffers with the allocator they came from
+  Image* image = CreateImage(4, 4, PF_I8, 256, PF_R8G8B8);
+  SetAllocator(0, 0);
+  const int frees = stats.frees;
+  delete ConvertImage(image, PF_R8G8B8A8);
+  CPPUNIT_ASSERT(stats.frees == frees + 2);
+  CPPUNIT_ASSERT(stats.allocations == stats.frees);
+  CPPUNIT_ASSERT(!stats.mismatched);
+}
+
+
+void
+APITests::testOpenImageInto() {
+  static const PixelFormat formats[] = {
+    PF_R8G8B8A8, PF_R8G8B8, PF_B8G8R8A8, PF_B8G8R8, PF_L8A8, PF_L8,
+  };
+  const int format_count = sizeof(formats) / sizeof(*formats);
+
+  const int image_count = sizeof(ALL_IMAGES) / sizeof(*ALL_IMAGES);
+  for (int i = 0; i < image_count; ++i) {
+    const string filename = ALL_IMAGES[i];
+    for (int f = 0; f < format_count; ++f) {
+      auto_ptr<Image> expected(OpenImage(filename, formats[f]));
+      if (!expected.get()) {
+        continue;
+      }
+
+      const int width  = expected->getWidth();
+      const int height = expected->getHeight();
+      const int pitch  = width * GetPixelSize(formats[f]) + 5;
+      byte* buffer = new byte[pitch * height];
+      auto_ptr<Image> target(
+        WrapImage(width, height, formats[f], buffer, 0, 0, pitch));
+
+      CPPUNIT_ASSERT_MESSAGE(filename, OpenImageInto(filename, target.get()));
+      AssertImagesEqual(filename, target.get(), expected.get());
+
+      // the dimensions have to match
+      auto_ptr<Image> too_wide(CreateImage(width + 1, height, formats[f]));
+      CPPUNIT_ASSERT(!OpenImageInto(filename, too_wide.get()));
+
+      target.reset();
+      delete[] buffer;
+    }
+  }
+
+  // PNG and JPEG files don't allocate any pixels, interlaced or not,
+  // unless a color PNG is going into a grey image
+  auto_ptr<Image> small(CreateImage(32, 32, PF_B8G8R8A8));
+  auto_ptr<Image> small_rgb(CreateImage(32, 32, PF_R8G8B8));
+  auto_ptr<Image> large(CreateImage(64, 64, PF_B8G8R8A8));
+  AllocatorStats stats = { 0, 0, false, false };
+  SetAllocator(CountingAllocate, CountingFree, &stats);
+  CPPUNIT_ASSERT(OpenImageInto("images/pngsuite/basn2c08.png", small.get()));
+  CPPUNIT_ASSERT(OpenImageInto("images/pngsuite/basn0g08.png", small.get()));
+  CPPUNIT_ASSERT(OpenImageInto("images/pngsuite/basi2c08.png", small.get()));
+  CPPUNIT_ASSERT(OpenImageInto("images/pngsuite/basi0g08.png", small.get()));
+  CPPUNIT_ASSERT(OpenImageInto("images/pngsuite/basi6a08.png",
+                               small_rgb.get()));
+  CPPUNIT_ASSERT(OpenImageInto("images/pngsuite/tbrn2c08.png",
+                               small_rgb.get()));
+  CPPUNIT_ASSERT(OpenImageInto("images/jpeg/64.jpeg", large.get()));
+  SetAllocator(0, 0);
+  CPPUNIT_ASSERT(stats.allocations == 0);
+}
+
+
+void
+APITests::testImageInfo() {
+  const int image_count = sizeof(ALL_IMAGES) / sizeof(*ALL_IMAGES);
+  for (int i = 0; i < image_count; ++i) {
+    const string filename = ALL_IMAGES[i];
+    auto_ptr<Image> image(OpenImage(filename));
+
+    ImageInfo info;
+    if (!GetImageInfo(filename, &info)) {
+      CPPUNIT_ASSERT_MESSAGE(filename, !image.get());
+      continue;
+    }
+    if (!image.get()) {
+      continue;  // corrupt past the header
+    }
+
+    CPPUNIT_ASSERT_MESSAGE(filename, info.width  == image->getWidth());
+    CPPUNIT_ASSERT_MESSAGE(filename, info.height == image->getHeight());
+    CPPUNIT_ASSERT_MESSAGE(filename, info.format == image->getFormat());
+    CPPUNIT_ASSERT_MESSAGE(filename,
+                           info.palette_size == image->getPaletteSize());
+    CPPUNIT_ASSERT_MESSAGE(filename,
+                           info.palette_format == image->getPaletteFormat());
+    CPPUNIT_ASSERT_MESSAGE(filename, info.file_format != FF_AUTODETECT);
+  }
+
+  // the first few hundred bytes are enough
+  static const struct {
+    const char* filename;
+    FileFormat format;
+  } headers[] = {
+    { "images/pngsuite/basn2c08.png", FF_PNG  },
+    { "images/jpeg/64.jpeg",          FF_JPEG },
+    { "images/bmpsuite/g24.bmp",      FF_BMP  },
+    { "images/gif/cover.gif",         FF_GIF  },
+  };
+  for (size_t i = 0; i < sizeof(headers) / sizeof(*headers); ++i) {
+    byte start[512];
+    auto_ptr<File> file(OpenFile(headers[i].filename, false));
+    CPPUNIT_ASSERT(file.get());
+    const int size = file->read(start, sizeof(start));
+
+    auto_ptr<File> header(CreateMemoryFile(start, size));
+    ImageInfo info;
+    CPPUNIT_ASSERT_MESSAGE(headers[i].filename,
+                           GetImageInfo(header.get(), &info));
+    CPPUNIT_ASSERT(info.file_format == headers[i].format);
+  }
+
+  ImageInfo info;
+  CPPUNIT_ASSERT(!GetImageInfo("images/bmpsuite/reference/reference.html",
+                               &info));
+  CPPUNIT_ASSERT(!GetImageInfo("nonexistent.png", &info));
+}
+
+
+void
+APITests::testAutodetect() {
+  static const FileFormat formats[] = {
+    FF_PNG, FF_JPEG, FF_PCX, FF_BMP, FF_TGA, FF_GIF
+  };
+
+  // sniffing the signature must pick the loader that trying them all
+  // in order would have
+  const int image_count = sizeof(ALL_IMAGES) / sizeof(*ALL_IMAGES);
+  for (int i = 0; i < image_count; ++i) {
+    const string filename = ALL_IMAGES[i];
+    auto_ptr<Image> expected;
+    FileFormat expected_format = FF_AUTODETECT;
+    for (size_t f = 0; f < sizeof(formats) / sizeof(*formats); ++f) {
+      expected.reset(OpenImage(filename, PF_DONTCARE, formats[f]));
+      if (expected.get()) {
+        expected_format = formats[f];
+        break;
+      }
+    }
+
+    auto_ptr<Image> image(OpenImage(filename));
+    if (!expected.get()) {
+      CPPUNIT_ASSERT_MESSAGE(filename, !image.get());
+      continue;
+    }
+    CPPUNIT_ASSERT_MESSAGE(filename, image.get() != 0);
+    AssertImagesEqual(filename, image.get(), expected.get());
+
+    ImageInfo info;
+    CPPUNIT_ASSERT_MESSAGE(filename, GetImageInfo(filename, &info));
+    CPPUNIT_ASSERT_MESSAGE(filename, info.file_format == expected_format);
+  }
+}
+
+
 Test*
 APITests::suite() {
   typedef TestCaller<APITests> Caller;
@@ -286,6 +788,14 @@ APITests::suite() {
   TestSuite* suite = new TestSuite();
   suite->addTest(new Caller("Basic API Tests",   &APITests::testAPI));
   suite->addTest(new Caller("Format Queries",    &APITests::testFormatQueries));
+  suite->addTest(new Caller("Planar Images",     &APITests::testPlanarImages));
   suite->addTest(new Caller("Memory Management", &APITests::testMemory));
+  suite->addTest(new Caller("Wrapped Buffers",   &APITests::testWrapImage));
+  suite->addTest(new Caller("Sub-Images",        &APITests::testSubImage));
+  suite->addTest(new Caller("Allocator Hook",    &APITests::testAllocator));
+  suite->addTest(new Caller("Decoding Into Images",
+                            &APITests::testOpenImageInto));
+  suite->addTest(new Caller("Image Info",        &APITests::testImageInfo));
+  suite->addTest(new Caller("Format Detection",  &APITests::testAutodetect));
   return suite;
 }
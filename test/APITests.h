@@ -10,7 +10,14 @@ public:
   void testBasicOperations(int width, int height);
   void testAPI();
   void testFormatQueries();
+  void testPlanarImages();
   void testMemory();
+  void testWrapImage();
+  void testSubImage();
+  void testAllocator();
+  void testOpenImageInto();
+  void testImageInfo();
+  void testAutodetect();
   static Test* suite();
 };
 
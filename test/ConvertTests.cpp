@@ -0,0 +1,390 @@
+#include "ConvertTests.h"
+
+
+static const PixelFormat direct_formats[] = {
+  PF_R8G8B8A8,
+  PF_R8G8B8,
+  PF_B8G8R8A8,
+  PF_B8G8R8,
+  PF_L8,
+  PF_L8A8,
+};
+static const int direct_format_count =
+  sizeof(direct_formats) / sizeof(*direct_formats);
+
+
+/**
+ * Converts every pixel of source on its own, as a 1x1 image.  Single
+ * pixels are too short for the vectorized kernels, so this always
+ * goes through the scalar conversion loop.
+ */
+Image* convertPixelByPixel(Image* source, PixelFormat format) {
+  const int width     = source->getWidth();
+  const int height    = source->getHeight();
+  const int in_size   = GetPixelSize(source->getFormat());
+  const int out_size  = GetPixelSize(format);
+
+  Image* result = CreateImage(width, height, format);
+  const byte* in = (const byte*)source->getPixels();
+  byte* out = (byte*)result->getPixels();
+  for (int i = 0; i < width * height; ++i) {
+    auto_ptr<Image> pixel(
+      ConvertImage(CreateImage(1, 1, source->getFormat(), (void*)in),
+                   format));
+    memcpy(out, pixel->getPixels(), out_size);
+    in  += in_size;
+    out += out_size;
+  }
+  return result;
+}
+
+
+void
+ConvertTests::testDirectConversions() {
+  // odd widths exercise the leftover pixels after each vector block
+  static const int widths[] = { 1, 2, 3, 5, 6, 7, 9, 10, 11, 16, 17, 33, 67 };
+  static const int width_count = sizeof(widths) / sizeof(*widths);
+  const int height = 3;
+
+  for (int w = 0; w < width_count; ++w) {
+    const int width = widths[w];
+
+    for (int i = 0; i < direct_format_count; ++i) {
+      const PixelFormat in_format = direct_formats[i];
+
+      auto_ptr<Image> source(CreateImage(width, height, in_format));
+      byte* pixels = (byte*)source->getPixels();
+      for (int p = 0; p < width * height * GetPixelSize(in_format); ++p) {
+        pixels[p] = byte(rand() % 256);
+      }
+
+      for (int j = 0; j < direct_format_count; ++j) {
+        const PixelFormat out_format = direct_formats[j];
+
+        auto_ptr<Image> converted(CloneImage(source.get(), out_format));
+        CPPUNIT_ASSERT(converted.get() != 0);
+
+        auto_ptr<Image> reference(
+          convertPixelByPixel(source.get(), out_format));
+        AssertImagesEqual("comparing with scalar conversion",
+                          converted.get(), reference.get());
+
+        // converting back should restore the color channels, and
+        // alpha if both formats have it
+        auto_ptr<Image> round_trip(CloneImage(converted.get(), in_format));
+        auto_ptr<Image> expected(
+          convertPixelByPixel(reference.get(), in_format));
+        AssertImagesEqual("comparing round trip",
+                          round_trip.get(), expected.get());
+      }
+    }
+  }
+}
+
+
+void
+ConvertTests::testInPlace() {
+  const int width  = 37;
+  const int height = 5;
+
+  auto_ptr<Image> rgba(CreateImage(width, height, PF_R8G8B8A8));
+  byte* pixels = (byte*)rgba->getPixels();
+  for (int i = 0; i < width * height * 4; ++i) {
+    pixels[i] = byte(rand() % 256);
+  }
+  auto_ptr<Image> reference(CloneImage(rgba.get(), PF_B8G8R8A8));
+
+  // same pixel size, so the buffer should be reused
+  Image* bgra = ConvertImage(rgba.release(), PF_B8G8R8A8);
+  CPPUNIT_ASSERT(bgra != 0);
+  CPPUNIT_ASSERT(bgra->getPixels() == pixels);
+  AssertImagesEqual("in-place RGBA -> BGRA", bgra, reference.get());
+
+  auto_ptr<Image> bgr(CloneImage(bgra, PF_B8G8R8));
+  delete bgra;
+  pixels = (byte*)bgr->getPixels();
+  auto_ptr<Image> rgb_reference(CloneImage(bgr.get(), PF_R8G8B8));
+
+  Image* rgb = ConvertImage(bgr.release(), PF_R8G8B8);
+  CPPUNIT_ASSERT(rgb != 0);
+  CPPUNIT_ASSERT(rgb->getPixels() == pixels);
+  AssertImagesEqual("in-place BGR -> RGB", rgb, rgb_reference.get());
+  delete rgb;
+}
+
+
+void
+ConvertTests::testPaletteExpansion() {
+  static const int widths[] = { 1, 7, 8, 9, 10, 11, 18, 19, 61 };
+  static const int width_count = sizeof(widths) / sizeof(*widths);
+  const int height = 2;
+
+  for (int w = 0; w < width_count; ++w) {
+    const int width = widths[w];
+
+    for (int i = 0; i < direct_format_count; ++i) {
+      const PixelFormat palette_format = direct_formats[i];
+      const int entry_size = GetPixelSize(palette_format);
+
+      auto_ptr<Image> source(
+        CreateImage(width, height, PF_I8, 256, palette_format));
+      byte* indices = (byte*)source->getPixels();
+      byte* palette = (byte*)source->getPalette();
+      for (int p = 0; p < width * height; ++p) {
+        indices[p] = byte(rand() % 256);
+      }
+      for (int p = 0; p < 256 * entry_size; ++p) {
+        palette[p] = byte(rand() % 256);
+      }
+
+      for (int j = 0; j < direct_format_count; ++j) {
+        const PixelFormat out_format = direct_formats[j];
+        const int out_size = GetPixelSize(out_format);
+
+        auto_ptr<Image> expanded(CloneImage(source.get(), out_format));
+        CPPUNIT_ASSERT(expanded.get() != 0);
+        CPPUNIT_ASSERT(expanded->getFormat() == out_format);
+
+        // every pixel should be its palette entry, converted
+        const byte* out = (const byte*)expanded->getPixels();
+        for (int p = 0; p < width * height; ++p) {
+          auto_ptr<Image> entry(ConvertImage(
+            CreateImage(1, 1, palette_format,
+                        palette + indices[p] * entry_size),
+            out_format));
+          CPPUNIT_ASSERT(memcmp(out, entry->getPixels(), out_size) == 0);
+          out += out_size;
+        }
+      }
+    }
+  }
+}
+
+
+void
+ConvertTests::testGreyscale() {
+  static const byte rgba[] = {
+    0,   0,   0,   10,
+    255, 255, 255, 20,
+    255, 0,   0,   30,
+    0,   255, 0,   40,
+    0,   0,   255, 50,
+    100, 150, 200, 60,
+  };
+  const int count = sizeof(rgba) / 4;
+
+  // colors become their Rec. 601 luma, and alpha is kept
+  auto_ptr<Image> source(CreateImage(count, 1, PF_R8G8B8A8, (void*)rgba));
+  auto_ptr<Image> la(CloneImage(source.get(), PF_L8A8));
+  CPPUNIT_ASSERT(la.get() != 0);
+  const byte* out = (const byte*)la->getPixels();
+  for (int i = 0; i < count; ++i) {
+    const byte* in = rgba + i * 4;
+    const int luma = (in[0] * 77 + in[1] * 150 + in[2] * 29 + 128) >> 8;
+    CPPUNIT_ASSERT_EQUAL(luma, int(out[i * 2]));
+    CPPUNIT_ASSERT_EQUAL(int(in[3]), int(out[i * 2 + 1]));
+  }
+  CPPUNIT_ASSERT_EQUAL(0,   int(out[0]));
+  CPPUNIT_ASSERT_EQUAL(255, int(out[2]));
+
+  // greys are copied into every color channel, and opaque without alpha
+  auto_ptr<Image> l(CloneImage(la.get(), PF_L8));
+  auto_ptr<Image> back(CloneImage(l.get(), PF_B8G8R8A8));
+  const byte* grey = (const byte*)l->getPixels();
+  const byte* bgra = (const byte*)back->getPixels();
+  for (int i = 0; i < count; ++i) {
+    CPPUNIT_ASSERT_EQUAL(int(out[i * 2]), int(grey[i]));
+    CPPUNIT_ASSERT_EQUAL(int(grey[i]), int(bgra[i * 4 + 0]));
+    CPPUNIT_ASSERT_EQUAL(int(grey[i]), int(bgra[i * 4 + 1]));
+    CPPUNIT_ASSERT_EQUAL(int(grey[i]), int(bgra[i * 4 + 2]));
+    CPPUNIT_ASSERT_EQUAL(255, int(bgra[i * 4 + 3]));
+  }
+
+  // palettes can be greyscale too
+  auto_ptr<Image> indexed(CreateImage(3, 1, PF_I8, 256, PF_L8A8));
+  byte* palette = (byte*)indexed->getPalette();
+  for (int i = 0; i < 256; ++i) {
+    palette[i * 2 + 0] = byte(255 - i);
+    palette[i * 2 + 1] = byte(i / 2);
+  }
+  byte* indices = (byte*)indexed->getPixels();
+  indices[0] = 0;
+  indices[1] = 100;
+  indices[2] = 255;
+  auto_ptr<Image> expanded(CloneImage(indexed.get(), PF_R8G8B8A8));
+  const byte* p = (const byte*)expanded->getPixels();
+  CPPUNIT_ASSERT_EQUAL(155, int(p[4]));
+  CPPUNIT_ASSERT_EQUAL(155, int(p[6]));
+  CPPUNIT_ASSERT_EQUAL(50,  int(p[7]));
+  CPPUNIT_ASSERT_EQUAL(0,   int(p[8]));
+  CPPUNIT_ASSERT_EQUAL(127, int(p[11]));
+}
+
+
+static const byte PADDING = 0xCD;
+
+
+/// Copies a tightly packed image into rows pitch bytes apart, filling
+/// the space between them with PADDING.
+byte* padRows(Image* image, int pitch) {
+  const int height   = image->getHeight();
+  const int row_size = image->getWidth() * GetPixelSize(image->getFormat());
+  byte* buffer = new byte[pitch * height];
+  memset(buffer, PADDING, pitch * height);
+  for (int h = 0; h < height; ++h) {
+    memcpy(buffer + h * pitch,
+           (byte*)image->getPixels() + h * row_size,
+           row_size);
+  }
+  return buffer;
+}
+
+
+bool paddingIntact(const byte* buffer, int row_size, int pitch, int height) {
+  for (int h = 0; h < height; ++h) {
+    for (int i = row_size; i < pitch; ++i) {
+      if (buffer[h * pitch + i] != PADDING) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+void COR_CALL deleteBytes(
+  void* buffer,
+  int /*size*/,
+  int /*alignment*/,
+  void* /*user_data*/)
+{
+  delete[] (byte*)buffer;
+}
+
+
+/// Saves image to memory and loads it back.
+Image* saveAndReload(Image* image, FileFormat file_format) {
+  auto_ptr<File> file(CreateMemoryFile(0, 0));
+  if (!SaveImage(file.get(), file_format, image)) {
+    return 0;
+  }
+  file->seek(0, File::BEGIN);
+  return OpenImage(file.get(), file_format, PF_R8G8B8A8);
+}
+
+
+void
+ConvertTests::testPitch() {
+  const int width    = 7;
+  const int height   = 5;
+  const int row_size = width * 4;
+  const int pitch    = row_size + 9;
+
+  auto_ptr<Image> packed(CreateImage(width, height, PF_R8G8B8A8));
+  byte* pixels = (byte*)packed->getPixels();
+  for (int p = 0; p < row_size * height; ++p) {
+    pixels[p] = byte(rand() % 256);
+  }
+
+  byte* buffer = padRows(packed.get(), pitch);
+  {
+    auto_ptr<Image> padded(
+      WrapImage(width, height, PF_R8G8B8A8, buffer, 0, 0, pitch));
+    CPPUNIT_ASSERT(padded.get() != 0);
+    CPPUNIT_ASSERT(padded->getPitch() == pitch);
+    CPPUNIT_ASSERT(packed->getPitch() == row_size);
+    AssertImagesEqual("wrapped", padded.get(), packed.get());
+
+    // cloning and converting
+    for (int i = 0; i < direct_format_count; ++i) {
+      const PixelFormat format = direct_formats[i];
+      auto_ptr<Image> expected(CloneImage(packed.get(), format));
+      auto_ptr<Image> cloned(CloneImage(padded.get(), format));
+      AssertImagesEqual("clone of padded image",
+                        cloned.get(), expected.get());
+    }
+
+    // flipping
+    auto_ptr<Image> expected(
+      FlipImage(CloneImage(packed.get()), CA_X | CA_Y));
+    CPPUNIT_ASSERT(FlipImage(padded.get(), CA_X | CA_Y) == padded.get());
+    AssertImagesEqual("flipped", padded.get(), expected.get());
+    FlipImage(padded.get(), CA_X | CA_Y);
+
+    // saving
+    static const FileFormat formats[] = { FF_PNG, FF_TGA, FF_JPEG };
+    for (int i = 0; i < 3; ++i) {
+      auto_ptr<Image> from_padded(saveAndReload(padded.get(), formats[i]));
+      auto_ptr<Image> from_packed(saveAndReload(packed.get(), formats[i]));
+      CPPUNIT_ASSERT(from_padded.get() != 0);
+      CPPUNIT_ASSERT(from_packed.get() != 0);
+      AssertImagesEqual("saved padded image",
+                        from_padded.get(), from_packed.get());
+    }
+  }
+  CPPUNIT_ASSERT(paddingIntact(buffer, row_size, pitch, height));
+
+  // in-place conversion keeps the pitch and the padding
+  byte* owned = padRows(packed.get(), pitch);
+  auto_ptr<Image> bgra(ConvertImage(
+    WrapImage(width, height, PF_R8G8B8A8, owned, deleteBytes, 0, pitch),
+    PF_B8G8R8A8));
+  CPPUNIT_ASSERT(bgra.get() != 0);
+  CPPUNIT_ASSERT(bgra->getPixels() == owned);
+  CPPUNIT_ASSERT(bgra->getPitch() == pitch);
+  auto_ptr<Image> expected(CloneImage(packed.get(), PF_B8G8R8A8));
+  AssertImagesEqual("converted in place", bgra.get(), expected.get());
+  CPPUNIT_ASSERT(paddingIntact(owned, row_size, pitch, height));
+
+  // palettized images
+  const int index_pitch = width + 3;
+  auto_ptr<Image> indexed(CreateImage(width, height, PF_I8, 256, PF_R8G8B8));
+  byte* indices = (byte*)indexed->getPixels();
+  for (int p = 0; p < width * height; ++p) {
+    indices[p] = byte(rand() % 256);
+  }
+  byte* palette = (byte*)indexed->getPalette();
+  for (int p = 0; p < 256 * 3; ++p) {
+    palette[p] = byte(rand() % 256);
+  }
+
+  byte* index_buffer = padRows(indexed.get(), index_pitch);
+  auto_ptr<Image> padded_indexed(
+    WrapImage(width, height, PF_I8, index_buffer,
+              palette, 256, PF_R8G8B8, 0, 0, index_pitch));
+  CPPUNIT_ASSERT(padded_indexed.get() != 0);
+  for (int i = 0; i < direct_format_count; ++i) {
+    const PixelFormat format = direct_formats[i];
+    auto_ptr<Image> expected(CloneImage(indexed.get(), format));
+    auto_ptr<Image> cloned(CloneImage(padded_indexed.get(), format));
+    AssertImagesEqual("expansion of padded image",
+                      cloned.get(), expected.get());
+  }
+
+  // too small a pitch is rejected
+  CPPUNIT_ASSERT(WrapImage(width, height, PF_R8G8B8A8, buffer,
+                           0, 0, row_size - 1) == 0);
+
+  padded_indexed.reset();
+  delete[] index_buffer;
+  delete[] buffer;
+}
+
+
+Test*
+ConvertTests::suite() {
+  typedef TestCaller<ConvertTests> Caller;
+
+  TestSuite* suite = new TestSuite();
+  suite->addTest(new Caller("Direct Color Conversions",
+                            &ConvertTests::testDirectConversions));
+  suite->addTest(new Caller("In-Place Conversions",
+                            &ConvertTests::testInPlace));
+  suite->addTest(new Caller("Palette Expansion",
+                            &ConvertTests::testPaletteExpansion));
+  suite->addTest(new Caller("Row Pitch",
+                            &ConvertTests::testPitch));
+  suite->addTest(new Caller("Greyscale Conversions",
+                            &ConvertTests::testGreyscale));
+  return suite;
+}
@@ -0,0 +1,19 @@
+#ifndef CONVERT_TESTS_H
+#define CONVERT_TESTS_H
+
+
+#include "ImageTestCase.h"
+
+
+class ConvertTests : public ImageTestCase {
+public:
+  void testDirectConversions();
+  void testInPlace();
+  void testPaletteExpansion();
+  void testPitch();
+  void testGreyscale();
+  static Test* suite();
+};
+
+
+#endif
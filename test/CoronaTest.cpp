@@ -1,6 +1,7 @@
 #include "TestFramework.h"
 #include "APITests.h"
 #include "BMPTests.h"
+#include "ConvertTests.h"
 #include "FileTests.h"
 #include "GIFTests.h"
 #include "JPEGTests.h"
@@ -13,6 +14,7 @@
 int main() {
   TextTestRunner runner;
   runner.addTest(APITests::suite());
+  runner.addTest(ConvertTests::suite());
   runner.addTest(FileTests::suite());
   runner.addTest(BMPTests::suite());
   runner.addTest(GIFTests::suite());
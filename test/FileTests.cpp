@@ -15,6 +15,42 @@ inline int GetFileSize(File* file) {
 }
 
 
+/// A File that is never in memory, to compare against mapped files.
+class StdioFile : public DLLImplementation<File> {
+public:
+  StdioFile(const char* filename) {
+    m_file = fopen(filename, "rb");
+  }
+
+  ~StdioFile() {
+    if (m_file) {
+      fclose(m_file);
+    }
+  }
+
+  int COR_CALL read(void* buffer, int size) {
+    return fread(buffer, 1, size, m_file);
+  }
+
+  int COR_CALL write(const void* /*buffer*/, int /*size*/) {
+    return 0;
+  }
+
+  bool COR_CALL seek(int position, SeekMode mode) {
+    const int whence = (mode == BEGIN ? SEEK_SET :
+                        mode == CURRENT ? SEEK_CUR : SEEK_END);
+    return fseek(m_file, position, whence) == 0;
+  }
+
+  int COR_CALL tell() {
+    return ftell(m_file);
+  }
+
+private:
+  FILE* m_file;
+};
+
+
 void
 FileTests::testMemoryFiles() {
   // a valid size but no data?
@@ -106,6 +142,103 @@ FileTests::testMemoryLoads() {
 }
 
 
+void
+FileTests::testReadOnlyMemoryFiles() {
+  char dummy[3] = { 1, 2, 3 };
+  CPPUNIT_ASSERT(CreateReadOnlyMemoryFile(0, 1) == 0);
+  CPPUNIT_ASSERT(CreateReadOnlyMemoryFile(dummy, -1) == 0);
+
+  // the buffer is read in place
+  auto_ptr<File> file(CreateReadOnlyMemoryFile(dummy, 3));
+  CPPUNIT_ASSERT(file.get() != 0);
+  int size = 0;
+  CPPUNIT_ASSERT(file->getContents(&size) == dummy);
+  CPPUNIT_ASSERT(size == 3);
+  CPPUNIT_ASSERT(file->write(dummy, 3) == 0);
+  CPPUNIT_ASSERT(GetFileSize(file.get()) == 3);
+
+  dummy[1] = 5;
+  char read[4];
+  CPPUNIT_ASSERT(file->read(read, 4) == 3);
+  CPPUNIT_ASSERT(read[0] == 1 && read[1] == 5 && read[2] == 3);
+
+  // save an image to memory and load it back without copying it
+  auto_ptr<Image> image(OpenImage("images/pngsuite/basn2c08.png"));
+  CPPUNIT_ASSERT(image.get() != 0);
+
+  auto_ptr<File> saved(CreateMemoryFile(0, 0));
+  CPPUNIT_ASSERT(SaveImage(saved.get(), FF_PNG, image.get()));
+  const void* contents = saved->getContents(&size);
+  CPPUNIT_ASSERT(contents != 0);
+  CPPUNIT_ASSERT(size == GetFileSize(saved.get()));
+
+  auto_ptr<File> borrowed(CreateReadOnlyMemoryFile(contents, size));
+  auto_ptr<Image> loaded(OpenImage(borrowed.get(), image->getFormat()));
+  CPPUNIT_ASSERT(loaded.get() != 0);
+  AssertImagesEqual("saved to memory", loaded.get(), image.get());
+}
+
+
+void
+FileTests::testMappedFiles() {
+  static string images[] = {
+    "bmpsuite/g08offs.bmp",
+    "bmpsuite/g08rle.bmp",
+    "gif/solid2.gif",
+    "jpeg/63-restart.jpeg",
+    "jpeg/64.jpeg",
+    "pcx/palettized.pcx",
+    "pngsuite/g07n3p04.png",
+    "targa/rgb.tga",
+  };
+  static const int image_count = sizeof(images) / sizeof(*images);
+
+  for (int i = 0; i < image_count; ++i) {
+    string filename = "images/" + images[i];
+
+    // files opened for reading expose their contents
+    auto_ptr<File> mapped(OpenFile(filename.c_str(), false));
+    CPPUNIT_ASSERT(mapped.get() != 0);
+    int size = 0;
+    const byte* contents = (const byte*)mapped->getContents(&size);
+    CPPUNIT_ASSERT_MESSAGE(images[i], contents != 0);
+    CPPUNIT_ASSERT(size == GetFileSize(mapped.get()));
+
+    StdioFile stdio_file(filename.c_str());
+    int stdio_size = 0;
+    CPPUNIT_ASSERT(stdio_file.getContents(&stdio_size) == 0);
+    CPPUNIT_ASSERT(GetFileSize(&stdio_file) == size);
+
+    byte* copy = new byte[size];
+    CPPUNIT_ASSERT(stdio_file.read(copy, size) == size);
+    CPPUNIT_ASSERT(memcmp(copy, contents, size) == 0);
+    CPPUNIT_ASSERT(stdio_file.seek(0, File::BEGIN));
+
+    // reads and seeks still work on mapped files
+    CPPUNIT_ASSERT(mapped->seek(-4, File::END));
+    CPPUNIT_ASSERT(mapped->read(copy, 8) == 4);
+    CPPUNIT_ASSERT(memcmp(copy, contents + size - 4, 4) == 0);
+    CPPUNIT_ASSERT(!mapped->seek(1, File::END));
+    delete[] copy;
+
+    // loaders that read the mapping in place decode the same image
+    auto_ptr<Image> mapped_image(OpenImage(mapped.get()));
+    auto_ptr<Image> stdio_image(OpenImage(&stdio_file));
+    CPPUNIT_ASSERT_MESSAGE(images[i], mapped_image.get() != 0);
+    CPPUNIT_ASSERT_MESSAGE(images[i], stdio_image.get() != 0);
+    AssertImagesEqual(images[i], mapped_image.get(), stdio_image.get());
+  }
+
+  // only read-only files are mapped
+  auto_ptr<File> written(OpenFile("mapped.tmp", true));
+  CPPUNIT_ASSERT(written.get() != 0);
+  int size;
+  CPPUNIT_ASSERT(written->getContents(&size) == 0);
+  written.reset();
+  remove("mapped.tmp");
+}
+
+
 Test*
 FileTests::suite() {
   typedef TestCaller<FileTests> Caller;
@@ -113,5 +246,8 @@ FileTests::suite() {
   TestSuite* suite = new TestSuite();
   suite->addTest(new Caller("MemoryFile Tests", &FileTests::testMemoryFiles));
   suite->addTest(new Caller("Load from MemoryFile", &FileTests::testMemoryLoads));
+  suite->addTest(new Caller("Read-only MemoryFile Tests",
+                            &FileTests::testReadOnlyMemoryFiles));
+  suite->addTest(new Caller("Mapped Files", &FileTests::testMappedFiles));
   return suite;
 }
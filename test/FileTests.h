@@ -9,6 +9,8 @@ class FileTests : public ImageTestCase {
 public:
   void testMemoryFiles();
   void testMemoryLoads();
+  void testReadOnlyMemoryFiles();
+  void testMappedFiles();
   static Test* suite();
 };
 
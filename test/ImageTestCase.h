@@ -42,12 +42,17 @@ public:
     PixelFormat i1_format = i1->getFormat();
     CPPUNIT_ASSERT_MESSAGE(message, i1_format == i2->getFormat());
 
-    // compare pixel data
-    int pixel_comparison = memcmp(
-      i1->getPixels(),
-      i2->getPixels(),
-      width * height * GetPixelSize(i1_format));
-    CPPUNIT_ASSERT_MESSAGE(message, pixel_comparison == 0);
+    // compare pixel data, a row at a time in case the pitches differ
+    const int row_size = width * GetPixelSize(i1_format);
+    const byte* p1 = (const byte*)i1->getPixels();
+    const byte* p2 = (const byte*)i2->getPixels();
+    for (int h = 0; h < height; ++h) {
+      int pixel_comparison = memcmp(
+        p1 + h * i1->getPitch(),
+        p2 + h * i2->getPitch(),
+        row_size);
+      CPPUNIT_ASSERT_MESSAGE(message, pixel_comparison == 0);
+    }
 
     // compare palette formats
     PixelFormat i1_plt_format = i1->getPaletteFormat();
@@ -73,6 +73,7 @@ const char* const ALL_IMAGES[] = {
   "images/gif/zemus2.gif",
   "images/jpeg/63-1-subsampling.jpeg",
   "images/jpeg/63-floating.jpeg",
+  "images/jpeg/63-greyscale.jpeg",
   "images/jpeg/63-high.jpeg",
   "images/jpeg/63-low.jpeg",
   "images/jpeg/63-progressive.jpeg",
@@ -82,6 +83,7 @@ const char* const ALL_IMAGES[] = {
   "images/jpeg/jack-incomplete.jpeg",
   "images/jpeg/ref/63-1-subsampling.png",
   "images/jpeg/ref/63-floating.png",
+  "images/jpeg/ref/63-greyscale.png",
   "images/jpeg/ref/63-high.png",
   "images/jpeg/ref/63-low.png",
   "images/jpeg/ref/63-progressive.png",
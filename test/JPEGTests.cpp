@@ -1,3 +1,4 @@
+#include <math.h>
 #include "JPEGTests.h"
 
 
@@ -7,6 +8,7 @@ JPEGTests::testLoader() {
     "63",
     "63-1-subsampling",
     "63-floating",
+    "63-greyscale",
     "63-high",
     "63-low",
     "63-progressive",
@@ -71,6 +73,433 @@ JPEGTests::testIncomplete() {
 }
 
 
+static string
+SaveJPEGToString(Image* image, const SaveOptions& options) {
+  auto_ptr<File> file(CreateMemoryFile(0, 0));
+  if (!SaveImage(file.get(), FF_JPEG, image, options)) {
+    return string();
+  }
+  const int size = file->tell();
+  string contents(size, '\0');
+  file->seek(0, File::BEGIN);
+  file->read(&contents[0], size);
+  return contents;
+}
+
+
+// returns the largest difference between two images' channels
+static int
+MaxDifference(Image* a, Image* b) {
+  const byte* pa = (const byte*)a->getPixels();
+  const byte* pb = (const byte*)b->getPixels();
+  const int size = getImageBufferSize(a);
+  int max = 0;
+  for (int i = 0; i < size; ++i) {
+    max = std::max(max, abs(pa[i] - pb[i]));
+  }
+  return max;
+}
+
+
+void
+JPEGTests::testOptions() {
+  auto_ptr<Image> image(OpenImage("images/jpeg/ref/63.png", PF_R8G8B8));
+  CPPUNIT_ASSERT(image.get() != 0);
+
+  static const ChromaSubsampling subsamplings[] = {
+    SS_444, SS_422, SS_420,
+  };
+  static const int luminance_sampling[] = { 0x11, 0x21, 0x22 };
+  static const DCTMethod methods[] = { DM_ISLOW, DM_IFAST, DM_FLOAT };
+
+  for (int s = 0; s < 3; ++s) {
+    for (int m = 0; m < 3; ++m) {
+      SaveOptions options;
+      options.jpeg_quality = 95;
+      options.jpeg_subsampling = subsamplings[s];
+      options.jpeg_dct_method = methods[m];
+      const string saved = SaveJPEGToString(image.get(), options);
+      CPPUNIT_ASSERT(!saved.empty());
+
+      // the luminance sampling factors are in the frame header
+      const string::size_type sof = saved.find("\xFF\xC0");
+      CPPUNIT_ASSERT(sof != string::npos);
+      CPPUNIT_ASSERT_EQUAL(luminance_sampling[s], int(byte(saved[sof + 11])));
+
+      auto_ptr<File> file(CreateMemoryFile(saved.data(), saved.size()));
+      auto_ptr<Image> loaded(OpenImage(file.get(), PF_R8G8B8, FF_JPEG));
+      CPPUNIT_ASSERT(loaded.get() != 0);
+      CPPUNIT_ASSERT_EQUAL(image->getWidth(),  loaded->getWidth());
+      CPPUNIT_ASSERT_EQUAL(image->getHeight(), loaded->getHeight());
+      CPPUNIT_ASSERT(MaxDifference(image.get(), loaded.get()) < 100);
+    }
+  }
+
+  // optimized Huffman tables are smaller, and restart markers show up
+  SaveOptions options;
+  const string plain = SaveJPEGToString(image.get(), options);
+  options.jpeg_optimize_coding = true;
+  const string optimized = SaveJPEGToString(image.get(), options);
+  CPPUNIT_ASSERT(optimized.size() < plain.size());
+  CPPUNIT_ASSERT(plain.find("\xFF\xD0") == string::npos);
+  options.jpeg_restart_interval = 2;
+  const string restarts = SaveJPEGToString(image.get(), options);
+  CPPUNIT_ASSERT(restarts.find("\xFF\xDD") != string::npos);
+  CPPUNIT_ASSERT(restarts.find("\xFF\xD0") != string::npos);
+
+  // lower quality, smaller file
+  options = SaveOptions();
+  options.jpeg_quality = 20;
+  CPPUNIT_ASSERT(SaveJPEGToString(image.get(), options).size() < plain.size());
+
+  options.jpeg_quality = 0;
+  CPPUNIT_ASSERT(SaveJPEGToString(image.get(), options).empty());
+  options.jpeg_quality = 101;
+  CPPUNIT_ASSERT(SaveJPEGToString(image.get(), options).empty());
+
+  options = SaveOptions();
+  options.jpeg_subsampling = ChromaSubsampling(42);
+  CPPUNIT_ASSERT(SaveJPEGToString(image.get(), options).empty());
+  options.jpeg_subsampling = ChromaSubsampling(SS_420 + 1);
+  CPPUNIT_ASSERT(SaveJPEGToString(image.get(), options).empty());
+
+  options = SaveOptions();
+  options.jpeg_dct_method = DCTMethod(42);
+  CPPUNIT_ASSERT(SaveJPEGToString(image.get(), options).empty());
+  options.jpeg_dct_method = DCTMethod(DM_FLOAT + 1);
+  CPPUNIT_ASSERT(SaveJPEGToString(image.get(), options).empty());
+
+  options = SaveOptions();
+  options.jpeg_restart_interval = -1;
+  CPPUNIT_ASSERT(SaveJPEGToString(image.get(), options).empty());
+
+  // other formats are converted a few rows at a time, and give the
+  // same file as the RGB image
+  static const PixelFormat formats[] = {
+    PF_R8G8B8A8, PF_B8G8R8A8, PF_B8G8R8,
+  };
+  for (int i = 0; i < 3; ++i) {
+    auto_ptr<Image> converted(CloneImage(image.get(), formats[i]));
+    CPPUNIT_ASSERT(plain == SaveJPEGToString(converted.get(), SaveOptions()));
+  }
+
+  // palettized images are looked up through their palette
+  auto_ptr<Image> paletted(OpenImage("images/gif/porsche.gif"));
+  CPPUNIT_ASSERT(paletted.get() != 0);
+  CPPUNIT_ASSERT(paletted->getFormat() == PF_I8);
+  auto_ptr<Image> expanded(CloneImage(paletted.get(), PF_R8G8B8));
+  CPPUNIT_ASSERT(SaveJPEGToString(expanded.get(), SaveOptions()) ==
+                 SaveJPEGToString(paletted.get(), SaveOptions()));
+
+  // including padded views
+  auto_ptr<Image> view(CreateSubImage(image.get(), 3, 5, 40, 30));
+  auto_ptr<Image> copy(CloneImage(view.get()));
+  CPPUNIT_ASSERT(SaveJPEGToString(copy.get(), SaveOptions()) ==
+                 SaveJPEGToString(view.get(), SaveOptions()));
+}
+
+
+void
+JPEGTests::testScaling() {
+  static const string filename = "images/jpeg/comic-progressive.jpeg";
+  auto_ptr<Image> full(OpenImage(filename, PF_R8G8B8));
+  CPPUNIT_ASSERT(full.get() != 0);
+  const int width  = full->getWidth();
+  const int height = full->getHeight();
+
+  for (int denominator = 1; denominator <= 8; denominator *= 2) {
+    OpenOptions options;
+    options.jpeg_scale_denominator = denominator;
+    auto_ptr<Image> scaled(OpenImage(filename, options, PF_R8G8B8));
+    CPPUNIT_ASSERT(scaled.get() != 0);
+
+    // sizes are rounded up
+    const int scaled_width  = (width  + denominator - 1) / denominator;
+    const int scaled_height = (height + denominator - 1) / denominator;
+    CPPUNIT_ASSERT_EQUAL(scaled_width,  scaled->getWidth());
+    CPPUNIT_ASSERT_EQUAL(scaled_height, scaled->getHeight());
+
+    // each pixel is close to the average of the pixels it covers
+    const byte* in = (const byte*)full->getPixels();
+    const byte* out = (const byte*)scaled->getPixels();
+    double total_error = 0;
+    for (int y = 0; y < height / denominator; ++y) {
+      for (int x = 0; x < width / denominator; ++x) {
+        for (int c = 0; c < 3; ++c) {
+          int sum = 0;
+          for (int j = 0; j < denominator; ++j) {
+            for (int i = 0; i < denominator; ++i) {
+              const int sx = x * denominator + i;
+              const int sy = y * denominator + j;
+              sum += in[(sy * width + sx) * 3 + c];
+            }
+          }
+          const int average = sum / (denominator * denominator);
+          total_error += abs(average - out[(y * scaled_width + x) * 3 + c]);
+        }
+      }
+    }
+    const int samples = (width / denominator) * (height / denominator) * 3;
+    CPPUNIT_ASSERT(total_error / samples < 3);
+  }
+
+  // the largest reduction that's still big enough
+  OpenOptions options;
+  options.jpeg_min_width = 200;
+  auto_ptr<Image> thumbnail(OpenImage(filename, options));
+  CPPUNIT_ASSERT(thumbnail.get() != 0);
+  CPPUNIT_ASSERT_EQUAL((width + 3) / 4, thumbnail->getWidth());
+
+  options.jpeg_min_width = 0;
+  options.jpeg_min_height = height;
+  thumbnail.reset(OpenImage(filename, options));
+  CPPUNIT_ASSERT(thumbnail.get() != 0);
+  CPPUNIT_ASSERT_EQUAL(height, thumbnail->getHeight());
+
+  options.jpeg_min_height = 1;
+  thumbnail.reset(OpenImage(filename, options));
+  CPPUNIT_ASSERT(thumbnail.get() != 0);
+  CPPUNIT_ASSERT_EQUAL((height + 7) / 8, thumbnail->getHeight());
+
+  // other formats come back at full size
+  OpenOptions eighth;
+  eighth.jpeg_scale_denominator = 8;
+  auto_ptr<Image> png(OpenImage("images/jpeg/ref/64.png", eighth));
+  CPPUNIT_ASSERT(png.get() != 0);
+  CPPUNIT_ASSERT_EQUAL(64, png->getWidth());
+
+  OpenOptions bad;
+  bad.jpeg_scale_denominator = 3;
+  CPPUNIT_ASSERT(OpenImage(filename, bad) == 0);
+}
+
+
+void
+JPEGTests::testGreyscale() {
+  static const string filename = "images/jpeg/63-greyscale.jpeg";
+
+  // one-component files load as grey, or spread into color on request
+  auto_ptr<Image> grey(OpenImage(filename));
+  CPPUNIT_ASSERT(grey.get() != 0);
+  CPPUNIT_ASSERT(grey->getFormat() == PF_L8);
+  auto_ptr<Image> rgb(OpenImage(filename, PF_R8G8B8));
+  CPPUNIT_ASSERT(rgb.get() != 0);
+  auto_ptr<Image> expanded(CloneImage(grey.get(), PF_R8G8B8));
+  AssertImagesEqual(filename, rgb.get(), expanded.get());
+
+  // grey images are saved with one component
+  const string saved = SaveJPEGToString(grey.get(), SaveOptions());
+  const string::size_type sof = saved.find("\xFF\xC0");
+  CPPUNIT_ASSERT(sof != string::npos);
+  CPPUNIT_ASSERT_EQUAL(1, int(byte(saved[sof + 9])));
+  CPPUNIT_ASSERT(saved.size() <
+                 SaveJPEGToString(rgb.get(), SaveOptions()).size());
+
+  auto_ptr<File> file(CreateMemoryFile(saved.data(), saved.size()));
+  auto_ptr<Image> loaded(OpenImage(file.get(), PF_DONTCARE, FF_JPEG));
+  CPPUNIT_ASSERT(loaded.get() != 0);
+  CPPUNIT_ASSERT(loaded->getFormat() == PF_L8);
+  CPPUNIT_ASSERT(MaxDifference(grey.get(), loaded.get()) < 32);
+
+  // alpha is dropped
+  auto_ptr<Image> alpha(CloneImage(grey.get(), PF_L8A8));
+  CPPUNIT_ASSERT(saved == SaveJPEGToString(alpha.get(), SaveOptions()));
+}
+
+
+// returns the average difference between one plane of a planar image
+// and the same component computed from an RGB image of the same size
+static double
+PlaneError(Image* planar, Image* rgb, int plane) {
+  static const int weights[3][3] = {
+    {  77,  150,  29 },
+    { -43,  -85, 128 },
+    { 128, -107, -21 },
+  };
+  const int* w = weights[plane];
+  const int bias = (plane == 0 ? 0 : 128);
+
+  const PixelFormat format = planar->getFormat();
+  const int width  = rgb->getWidth();
+  const int height = rgb->getHeight();
+  const int plane_width  = GetPlaneWidth(format, width, plane);
+  const int plane_height = GetPlaneHeight(format, height, plane);
+  const int sx = (width  + plane_width  - 1) / plane_width;
+  const int sy = (height + plane_height - 1) / plane_height;
+
+  const byte* in = (const byte*)rgb->getPixels();
+  const byte* out = (const byte*)GetPlane(planar, plane);
+  double total = 0;
+  for (int y = 0; y < plane_height; ++y) {
+    for (int x = 0; x < plane_width; ++x) {
+      // average the pixels the sample covers
+      int sum = 0;
+      int count = 0;
+      for (int j = y * sy; j < std::min(height, (y + 1) * sy); ++j) {
+        for (int i = x * sx; i < std::min(width, (x + 1) * sx); ++i) {
+          const byte* p = in + (j * width + i) * 3;
+          sum += bias * 256 + w[0] * p[0] + w[1] * p[1] + w[2] * p[2];
+          ++count;
+        }
+      }
+      const double expected = sum / (256.0 * count);
+      total += fabs(expected - out[y * plane_width + x]);
+    }
+  }
+  return total / (plane_width * plane_height);
+}
+
+
+void
+JPEGTests::testPlanes() {
+  auto_ptr<Image> image(OpenImage("images/jpeg/ref/63.png", PF_R8G8B8));
+  CPPUNIT_ASSERT(image.get() != 0);
+
+  static const ChromaSubsampling subsamplings[] = {
+    SS_444, SS_422, SS_420,
+  };
+  static const PixelFormat formats[] = {
+    PF_YCbCr444, PF_YCbCr422, PF_YCbCr420,
+  };
+
+  OpenOptions planes;
+  planes.jpeg_ycbcr_planes = true;
+
+  for (int s = 0; s < 3; ++s) {
+    SaveOptions options;
+    options.jpeg_subsampling = subsamplings[s];
+    const string saved = SaveJPEGToString(image.get(), options);
+    auto_ptr<File> file(CreateMemoryFile(saved.data(), saved.size()));
+
+    // the planes come back at the file's own subsampling
+    auto_ptr<Image> planar(OpenImage(file.get(), planes));
+    CPPUNIT_ASSERT(planar.get() != 0);
+    CPPUNIT_ASSERT(planar->getFormat() == formats[s]);
+    CPPUNIT_ASSERT_EQUAL(image->getWidth(),  planar->getWidth());
+    CPPUNIT_ASSERT_EQUAL(image->getHeight(), planar->getHeight());
+
+    // and match what the color decode was made from
+    file->seek(0, File::BEGIN);
+    auto_ptr<Image> rgb(OpenImage(file.get(), PF_R8G8B8, FF_JPEG));
+    CPPUNIT_ASSERT(rgb.get() != 0);
+    for (int c = 0; c < 3; ++c) {
+      CPPUNIT_ASSERT(PlaneError(planar.get(), rgb.get(), c) < 3);
+    }
+
+    // scaling 4:2:0 down leaves the chroma planes full size
+    file->seek(0, File::BEGIN);
+    OpenOptions half(planes);
+    half.jpeg_scale_denominator = 2;
+    auto_ptr<Image> scaled(OpenImage(file.get(), half));
+    CPPUNIT_ASSERT(scaled.get() != 0);
+    CPPUNIT_ASSERT(scaled->getFormat() ==
+                   (formats[s] == PF_YCbCr420 ? PF_YCbCr444 : formats[s]));
+    CPPUNIT_ASSERT_EQUAL((image->getWidth() + 1) / 2, scaled->getWidth());
+    file->seek(0, File::BEGIN);
+    half.jpeg_ycbcr_planes = false;
+    rgb.reset(OpenImage(file.get(), half, PF_R8G8B8, FF_JPEG));
+    CPPUNIT_ASSERT(rgb.get() != 0);
+    for (int c = 0; c < 3; ++c) {
+      CPPUNIT_ASSERT(PlaneError(scaled.get(), rgb.get(), c) < 3);
+    }
+  }
+
+  // files without YCbCr planes decode as usual
+  auto_ptr<Image> grey(OpenImage("images/jpeg/63-greyscale.jpeg", planes));
+  CPPUNIT_ASSERT(grey.get() != 0);
+  CPPUNIT_ASSERT(grey->getFormat() == PF_L8);
+
+  // and other formats ignore the option
+  auto_ptr<Image> png(OpenImage("images/jpeg/ref/63.png", planes));
+  CPPUNIT_ASSERT(png.get() != 0);
+  CPPUNIT_ASSERT(!IsPlanar(png->getFormat()));
+
+  // planar images can't be converted
+  CPPUNIT_ASSERT(OpenImage("images/jpeg/63.jpeg", planes, PF_R8G8B8) == 0);
+}
+
+
+// returns the average difference between two planar images' samples
+static double
+PlanarDifference(Image* a, Image* b) {
+  const int size = GetPlaneOffset(a->getFormat(),
+                                  a->getWidth(), a->getHeight(), 3);
+  const byte* pa = (const byte*)a->getPixels();
+  const byte* pb = (const byte*)b->getPixels();
+  double total = 0;
+  for (int i = 0; i < size; ++i) {
+    total += abs(pa[i] - pb[i]);
+  }
+  return total / size;
+}
+
+
+void
+JPEGTests::testPlanarSave() {
+  auto_ptr<Image> image(OpenImage("images/jpeg/ref/63.png", PF_R8G8B8));
+  CPPUNIT_ASSERT(image.get() != 0);
+
+  static const ChromaSubsampling subsamplings[] = {
+    SS_444, SS_422, SS_420,
+  };
+  static const int luminance_sampling[] = { 0x11, 0x21, 0x22 };
+
+  OpenOptions planes;
+  planes.jpeg_ycbcr_planes = true;
+
+  // 63 pixels need padding out to whole blocks, and 48 don't
+  auto_ptr<Image> view(CreateSubImage(image.get(), 0, 0, 48, 48));
+  auto_ptr<Image> square(CloneImage(view.get()));
+  Image* sources[] = { image.get(), square.get() };
+
+  for (int i = 0; i < 2; ++i) {
+    for (int s = 0; s < 3; ++s) {
+      SaveOptions options;
+      options.jpeg_quality = 95;
+      options.jpeg_subsampling = subsamplings[s];
+      const string original = SaveJPEGToString(sources[i], options);
+      auto_ptr<File> file(CreateMemoryFile(original.data(), original.size()));
+      auto_ptr<Image> planar(OpenImage(file.get(), planes));
+      CPPUNIT_ASSERT(planar.get() != 0);
+      CPPUNIT_ASSERT(IsPlanar(planar->getFormat()));
+
+      // the planes keep their own subsampling
+      options.jpeg_subsampling = SS_444;
+      const string saved = SaveJPEGToString(planar.get(), options);
+      CPPUNIT_ASSERT(!saved.empty());
+      const string::size_type sof = saved.find("\xFF\xC0");
+      CPPUNIT_ASSERT(sof != string::npos);
+      CPPUNIT_ASSERT_EQUAL(3, int(byte(saved[sof + 9])));
+      CPPUNIT_ASSERT_EQUAL(luminance_sampling[s], int(byte(saved[sof + 11])));
+
+      // and come back much as they were
+      file.reset(CreateMemoryFile(saved.data(), saved.size()));
+      auto_ptr<Image> loaded(OpenImage(file.get(), planes));
+      CPPUNIT_ASSERT(loaded.get() != 0);
+      CPPUNIT_ASSERT(loaded->getFormat() == planar->getFormat());
+      CPPUNIT_ASSERT_EQUAL(planar->getWidth(),  loaded->getWidth());
+      CPPUNIT_ASSERT_EQUAL(planar->getHeight(), loaded->getHeight());
+      CPPUNIT_ASSERT(PlanarDifference(planar.get(), loaded.get()) < 1);
+
+      file->seek(0, File::BEGIN);
+      auto_ptr<Image> rgb(OpenImage(file.get(), PF_R8G8B8, FF_JPEG));
+      CPPUNIT_ASSERT(rgb.get() != 0);
+      CPPUNIT_ASSERT(MaxDifference(sources[i], rgb.get()) < 100);
+    }
+  }
+
+  // the other options still apply
+  auto_ptr<Image> planar(CreateImage(63, 63, PF_YCbCr420));
+  CPPUNIT_ASSERT(planar.get() != 0);
+  SaveOptions options;
+  options.jpeg_restart_interval = 1;
+  const string restarts = SaveJPEGToString(planar.get(), options);
+  CPPUNIT_ASSERT(restarts.find("\xFF\xDD") != string::npos);
+  options.jpeg_quality = 0;
+  CPPUNIT_ASSERT(SaveJPEGToString(planar.get(), options).empty());
+}
+
+
 Test*
 JPEGTests::suite() {
   typedef TestCaller<JPEGTests> Caller;
@@ -79,5 +508,10 @@ JPEGTests::suite() {
   suite->addTest(new Caller("JPEG Loader", &JPEGTests::testLoader));
   suite->addTest(new Caller("JPEG Saver",  &JPEGTests::testSaver));
   suite->addTest(new Caller("Incomplete JPEG", &JPEGTests::testIncomplete));
+  suite->addTest(new Caller("JPEG Save Options", &JPEGTests::testOptions));
+  suite->addTest(new Caller("JPEG Scaling", &JPEGTests::testScaling));
+  suite->addTest(new Caller("JPEG Greyscale", &JPEGTests::testGreyscale));
+  suite->addTest(new Caller("JPEG YCbCr Planes", &JPEGTests::testPlanes));
+  suite->addTest(new Caller("JPEG Planar Save",  &JPEGTests::testPlanarSave));
   return suite;
 }
@@ -10,6 +10,11 @@ public:
   void testLoader();
   void testSaver();
   void testIncomplete();
+  void testOptions();
+  void testScaling();
+  void testGreyscale();
+  void testPlanes();
+  void testPlanarSave();
   static Test* suite();
 };
 
@@ -249,6 +249,310 @@ PNGTests::testWriter() {
 }
 
 
+void
+PNGTests::testFilters() {
+  // Sub, Average and Paeth have vectorized versions for 3- and 4-byte
+  // pixels.  Saving lets libpng pick a filter per row, so reloading
+  // the file runs every unfilter over real image data.
+  static const char* images[] = {
+    "basn2c08.png",
+    "basn2c16.png",
+    "basn6a08.png",
+    "basn6a16.png",
+    "basi2c08.png",
+    "basi6a08.png",
+    "f00n2c08.png",
+    "f01n2c08.png",
+    "f02n2c08.png",
+    "f03n2c08.png",
+    "f04n2c08.png",
+    "pngsuite_logo.png",
+    "s01n3p01.png",
+    "s03n3p01.png",
+    "s09n3p02.png",
+    "s39n3p04.png",
+    "s40n3p04.png",
+    "tp0n2c08.png",
+    "z09n2c08.png",
+  };
+  static const int image_count = sizeof(images) / sizeof(*images);
+
+  static const PixelFormat formats[] = { PF_R8G8B8, PF_R8G8B8A8 };
+
+  for (int i = 0; i < image_count; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      const string fn = string("images/pngsuite/") + images[i];
+      auto_ptr<Image> image(OpenImage(fn, formats[j]));
+      CPPUNIT_ASSERT_MESSAGE("opening " + fn, image.get() != 0);
+
+      auto_ptr<File> file(CreateMemoryFile(0, 0));
+      CPPUNIT_ASSERT(SaveImage(file.get(), FF_PNG, image.get()));
+      file->seek(0, File::BEGIN);
+
+      auto_ptr<Image> loaded(OpenImage(file.get(), formats[j], FF_PNG));
+      CPPUNIT_ASSERT_MESSAGE("reloading " + fn, loaded.get() != 0);
+      AssertImagesEqual("unfiltering " + fn, loaded.get(), image.get());
+    }
+  }
+}
+
+
+void
+PNGTests::testOptions() {
+  auto_ptr<Image> image(OpenImage("images/pngsuite/basn2c08.png", PF_R8G8B8));
+  CPPUNIT_ASSERT(image.get() != 0);
+
+  static const RowFilter filters[] = {
+    RF_ADAPTIVE, RF_NONE, RF_SUB, RF_UP, RF_AVERAGE, RF_PAETH,
+  };
+  static const CompressionStrategy strategies[] = {
+    CS_DEFAULT, CS_FILTERED, CS_HUFFMAN_ONLY, CS_RLE,
+  };
+
+  for (int f = 0; f < 6; ++f) {
+    for (int s = 0; s < 4; ++s) {
+      for (int level = -1; level <= 9; level += 5) {
+        SaveOptions options;
+        options.png_compression_level = level;
+        options.png_strategy = strategies[s];
+        options.png_filter = filters[f];
+
+        auto_ptr<File> file(CreateMemoryFile(0, 0));
+        CPPUNIT_ASSERT(SaveImage(file.get(), FF_PNG, image.get(), options));
+        file->seek(0, File::BEGIN);
+
+        auto_ptr<Image> loaded(OpenImage(file.get(), PF_R8G8B8, FF_PNG));
+        CPPUNIT_ASSERT(loaded.get() != 0);
+        AssertImagesEqual("saving with options", loaded.get(), image.get());
+      }
+    }
+  }
+
+  // BGR images are saved without a conversion, and come back the same
+  SaveOptions fast = FastSaveOptions();
+  auto_ptr<Image> bgr(CloneImage(image.get(), PF_B8G8R8A8));
+  auto_ptr<File> file(CreateMemoryFile(0, 0));
+  CPPUNIT_ASSERT(SaveImage(file.get(), FF_PNG, bgr.get(), fast));
+  file->seek(0, File::BEGIN);
+  auto_ptr<Image> loaded(OpenImage(file.get(), PF_B8G8R8A8, FF_PNG));
+  CPPUNIT_ASSERT(loaded.get() != 0);
+  AssertImagesEqual("saving BGRA", loaded.get(), bgr.get());
+
+  // rows are written from the image's own memory, padding and all
+  auto_ptr<Image> view(CreateSubImage(image.get(), 3, 5, 17, 11));
+  file.reset(CreateMemoryFile(0, 0));
+  CPPUNIT_ASSERT(SaveImage(file.get(), FF_PNG, view.get(), fast));
+  file->seek(0, File::BEGIN);
+  loaded.reset(OpenImage(file.get(), PF_R8G8B8, FF_PNG));
+  CPPUNIT_ASSERT(loaded.get() != 0);
+  auto_ptr<Image> copy(CloneImage(view.get()));
+  AssertImagesEqual("saving a view", loaded.get(), copy.get());
+
+  SaveOptions bad;
+  bad.png_compression_level = 10;
+  file.reset(CreateMemoryFile(0, 0));
+  CPPUNIT_ASSERT(!SaveImage(file.get(), FF_PNG, image.get(), bad));
+
+  bad = SaveOptions();
+  bad.png_strategy = CompressionStrategy(CS_RLE + 1);
+  CPPUNIT_ASSERT(!SaveImage(file.get(), FF_PNG, image.get(), bad));
+  bad.png_strategy = CompressionStrategy(0);
+  CPPUNIT_ASSERT(!SaveImage(file.get(), FF_PNG, image.get(), bad));
+
+  bad = SaveOptions();
+  bad.png_filter = RowFilter(RF_PAETH + 1);
+  CPPUNIT_ASSERT(!SaveImage(file.get(), FF_PNG, image.get(), bad));
+  bad.png_filter = RowFilter(RF_ADAPTIVE - 1);
+  CPPUNIT_ASSERT(!SaveImage(file.get(), FF_PNG, image.get(), bad));
+}
+
+
+static string
+SaveToString(Image* image, const SaveOptions& options) {
+  auto_ptr<File> file(CreateMemoryFile(0, 0));
+  if (!SaveImage(file.get(), FF_PNG, image, options)) {
+    return string();
+  }
+  const int size = file->tell();
+  string contents(size, '\0');
+  file->seek(0, File::BEGIN);
+  file->read(&contents[0], size);
+  return contents;
+}
+
+
+void
+PNGTests::testThreads() {
+  // big enough to be split into several chunks
+  const int width  = 300;
+  const int height = 700;
+  auto_ptr<Image> image(CreateImage(width, height, PF_R8G8B8A8));
+  CPPUNIT_ASSERT(image.get() != 0);
+  byte* pixels = (byte*)image->getPixels();
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      byte* p = pixels + (y * width + x) * 4;
+      p[0] = byte(x ^ y);
+      p[1] = byte(x * y / 64);
+      p[2] = byte((x + y) % 7 == 0 ? 255 : y);
+      p[3] = byte(x < 100 ? 255 : x + y);
+    }
+  }
+
+  // a palettized copy, using the red channel as the index
+  auto_ptr<Image> paletted(
+    CreateImage(width, height, PF_I8, 256, PF_R8G8B8));
+  CPPUNIT_ASSERT(paletted.get() != 0);
+  byte* palette = (byte*)paletted->getPalette();
+  for (int i = 0; i < 256; ++i) {
+    palette[i * 3 + 0] = byte(i);
+    palette[i * 3 + 1] = byte(255 - i);
+    palette[i * 3 + 2] = byte(i * 3);
+  }
+  byte* indices = (byte*)paletted->getPixels();
+  for (int i = 0; i < width * height; ++i) {
+    indices[i] = pixels[i * 4];
+  }
+
+  static const PixelFormat formats[] = {
+    PF_R8G8B8A8, PF_R8G8B8, PF_B8G8R8A8, PF_B8G8R8, PF_I8, PF_L8, PF_L8A8,
+  };
+  static const RowFilter filters[] = {
+    RF_ADAPTIVE, RF_NONE, RF_SUB, RF_UP, RF_AVERAGE, RF_PAETH,
+  };
+
+  for (int i = 0; i < 7; ++i) {
+    auto_ptr<Image> source(formats[i] == PF_I8 ?
+                           CloneImage(paletted.get()) :
+                           CloneImage(image.get(), formats[i]));
+    CPPUNIT_ASSERT(source.get() != 0);
+
+    // palettized images load as direct color
+    auto_ptr<Image> expected(formats[i] == PF_I8 ?
+                             CloneImage(source.get(), PF_R8G8B8) :
+                             CloneImage(source.get()));
+
+    for (int f = 0; f < 6; ++f) {
+      SaveOptions options;
+      options.png_filter = filters[f];
+      options.threads = 4;
+      const string saved = SaveToString(source.get(), options);
+      CPPUNIT_ASSERT(!saved.empty());
+
+      auto_ptr<File> file(CreateMemoryFile(saved.data(), saved.size()));
+      auto_ptr<Image> loaded(OpenImage(file.get(), expected->getFormat(),
+                                       FF_PNG));
+      CPPUNIT_ASSERT(loaded.get() != 0);
+      AssertImagesEqual("saving on threads", loaded.get(), expected.get());
+
+      // the file doesn't depend on timing or the number of threads
+      CPPUNIT_ASSERT(saved == SaveToString(source.get(), options));
+      options.threads = 2;
+      CPPUNIT_ASSERT(saved == SaveToString(source.get(), options));
+      options.threads = 16;
+      CPPUNIT_ASSERT(saved == SaveToString(source.get(), options));
+    }
+  }
+
+  // other levels and strategies
+  SaveOptions fast = FastSaveOptions();
+  fast.threads = 3;
+  fast.png_strategy = CS_HUFFMAN_ONLY;
+  for (int level = 0; level <= 9; level += 3) {
+    fast.png_compression_level = level;
+    const string saved = SaveToString(image.get(), fast);
+    auto_ptr<File> file(CreateMemoryFile(saved.data(), saved.size()));
+    auto_ptr<Image> loaded(OpenImage(file.get(), PF_R8G8B8A8, FF_PNG));
+    CPPUNIT_ASSERT(loaded.get() != 0);
+    AssertImagesEqual("saving fast on threads", loaded.get(), image.get());
+  }
+
+  // bad options fail on threads too, instead of writing a broken file
+  SaveOptions bad;
+  bad.threads = 4;
+  bad.png_filter = RowFilter(0x410);
+  CPPUNIT_ASSERT(SaveToString(image.get(), bad).empty());
+  bad = SaveOptions();
+  bad.threads = 4;
+  bad.png_strategy = CompressionStrategy(0x310);
+  CPPUNIT_ASSERT(SaveToString(image.get(), bad).empty());
+}
+
+
+void
+PNGTests::testGreyscale() {
+  static const string base = "images/pngsuite/";
+
+  // grey images load without being expanded to color
+  static const char* grey[] = {
+    "basn0g01.png",
+    "basn0g02.png",
+    "basn0g04.png",
+    "basn0g08.png",
+    "basn0g16.png",
+    "basn4a08.png",
+    "basn4a16.png",
+  };
+  for (int i = 0; i < 7; ++i) {
+    const string filename = base + grey[i];
+    auto_ptr<Image> image(OpenImage(filename));
+    CPPUNIT_ASSERT(image.get() != 0);
+    const PixelFormat expected = (i < 5 ? PF_L8 : PF_L8A8);
+    CPPUNIT_ASSERT_MESSAGE(filename, image->getFormat() == expected);
+
+    // and asking for color gives the same pixels
+    auto_ptr<Image> rgba(OpenImage(filename, PF_R8G8B8A8));
+    CPPUNIT_ASSERT(rgba.get() != 0);
+    auto_ptr<Image> expanded(CloneImage(image.get(), PF_R8G8B8A8));
+    AssertImagesEqual(filename, rgba.get(), expanded.get());
+
+    // grey images are saved as grey (color type 0 or 4 in the IHDR),
+    // and come back unchanged
+    const string saved = SaveToString(image.get(), SaveOptions());
+    CPPUNIT_ASSERT(saved.size() > 26);
+    const int color_type = (expected == PF_L8 ? 0 : 4);
+    CPPUNIT_ASSERT_EQUAL(color_type, int(byte(saved[25])));
+
+    auto_ptr<File> file(CreateMemoryFile(saved.data(), saved.size()));
+    auto_ptr<Image> loaded(OpenImage(file.get(), PF_DONTCARE, FF_PNG));
+    CPPUNIT_ASSERT(loaded.get() != 0);
+    AssertImagesEqual(filename, loaded.get(), image.get());
+  }
+
+  // color images can be decoded straight to grey
+  auto_ptr<Image> color(OpenImage(base + "basn6a08.png", PF_R8G8B8A8));
+  auto_ptr<Image> direct(OpenImage(base + "basn6a08.png", PF_L8A8));
+  CPPUNIT_ASSERT(direct.get() != 0);
+  auto_ptr<Image> converted(CloneImage(color.get(), PF_L8A8));
+  AssertImagesEqual("grey from color", direct.get(), converted.get());
+
+  // palettes in any direct format are saved as RGB
+  static const PixelFormat palette_formats[] = { PF_L8, PF_B8G8R8 };
+  for (int f = 0; f < 2; ++f) {
+    auto_ptr<Image> paletted(CreateImage(4, 1, PF_I8, 256,
+                                         palette_formats[f]));
+    CPPUNIT_ASSERT(paletted.get() != 0);
+    const int entry_size = GetPixelSize(palette_formats[f]);
+    byte* palette = (byte*)paletted->getPalette();
+    for (int i = 0; i < 256 * entry_size; ++i) {
+      palette[i] = byte(255 - i / entry_size + i % entry_size);
+    }
+    byte* indices = (byte*)paletted->getPixels();
+    indices[0] = 0;
+    indices[1] = 10;
+    indices[2] = 100;
+    indices[3] = 255;
+
+    const string saved = SaveToString(paletted.get(), SaveOptions());
+    auto_ptr<File> file(CreateMemoryFile(saved.data(), saved.size()));
+    auto_ptr<Image> loaded(OpenImage(file.get(), PF_R8G8B8, FF_PNG));
+    CPPUNIT_ASSERT(loaded.get() != 0);
+    auto_ptr<Image> expected(CloneImage(paletted.get(), PF_R8G8B8));
+    AssertImagesEqual("saving a palette", loaded.get(), expected.get());
+  }
+}
+
+
 Test*
 PNGTests::suite() {
   typedef TestCaller<PNGTests> Caller;
@@ -256,5 +560,10 @@ PNGTests::suite() {
   TestSuite* suite = new TestSuite();
   suite->addTest(new Caller("Test PNG Loader", &PNGTests::testLoader));
   suite->addTest(new Caller("Test PNG Writer", &PNGTests::testWriter));
+  suite->addTest(new Caller("Test PNG Filters", &PNGTests::testFilters));
+  suite->addTest(new Caller("Test PNG Save Options", &PNGTests::testOptions));
+  suite->addTest(new Caller("Test PNG Threads", &PNGTests::testThreads));
+  suite->addTest(new Caller("Test PNG Greyscale",
+                            &PNGTests::testGreyscale));
   return suite;
 }
@@ -9,6 +9,10 @@ class PNGTests : public ImageTestCase {
 public:
   void testLoader();
   void testWriter();
+  void testFilters();
+  void testOptions();
+  void testThreads();
+  void testGreyscale();
   static Test* suite();
 };
 
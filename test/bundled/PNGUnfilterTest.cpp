@@ -0,0 +1,214 @@
+/**
+ * Checks the row unfilters in the bundled libpng.
+ *
+ * SConscript builds this twice: once as is, and once with
+ * PNG_NO_INTEL_SSE, which leaves only the scalar unfilters in
+ * pngrutil.c.  Each build writes random images with every filter type
+ * and checks that they decode to the original pixels, then prints a
+ * CRC of every decoded image given on the command line.  run-tests.sh
+ * compares the two outputs.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <vector>
+#include "png.h"
+#include "zlib.h"
+
+
+typedef unsigned char byte;
+
+
+struct Buffer {
+  std::vector<byte> data;
+  size_t position;
+};
+
+
+void PNG_write(png_structp png_ptr, png_bytep data, png_size_t size) {
+  Buffer* buffer = (Buffer*)png_get_io_ptr(png_ptr);
+  buffer->data.insert(buffer->data.end(), data, data + size);
+}
+
+
+void PNG_flush(png_structp /*png_ptr*/) {
+}
+
+
+void PNG_read(png_structp png_ptr, png_bytep data, png_size_t size) {
+  Buffer* buffer = (Buffer*)png_get_io_ptr(png_ptr);
+  if (buffer->position + size > buffer->data.size()) {
+    png_error(png_ptr, "read past end of buffer");
+  }
+  memcpy(data, &buffer->data[buffer->position], size);
+  buffer->position += size;
+}
+
+
+void PNG_warning(png_structp /*png_ptr*/, png_const_charp /*message*/) {
+}
+
+
+/**
+ * Decodes a whole PNG, with the interlacing undone, into pixels.
+ *
+ * @return  true on success
+ */
+bool Decode(png_rw_ptr read, void* io, FILE* file,
+            std::vector<byte>& pixels)
+{
+  png_structp png_ptr = png_create_read_struct(
+    PNG_LIBPNG_VER_STRING, 0, 0, PNG_warning);
+  if (!png_ptr) {
+    return false;
+  }
+  png_infop info_ptr = png_create_info_struct(png_ptr);
+  if (!info_ptr) {
+    png_destroy_read_struct(&png_ptr, 0, 0);
+    return false;
+  }
+
+  std::vector<png_bytep> rows;
+  if (setjmp(png_jmpbuf(png_ptr))) {
+    png_destroy_read_struct(&png_ptr, &info_ptr, 0);
+    return false;
+  }
+
+  if (file) {
+    png_init_io(png_ptr, file);
+  } else {
+    png_set_read_fn(png_ptr, io, read);
+  }
+  png_read_info(png_ptr, info_ptr);
+  png_set_interlace_handling(png_ptr);
+  png_read_update_info(png_ptr, info_ptr);
+
+  const size_t row_size = png_get_rowbytes(png_ptr, info_ptr);
+  const int height = png_get_image_height(png_ptr, info_ptr);
+  pixels.assign(row_size * height, 0);
+  rows.resize(height);
+  for (int i = 0; i < height; ++i) {
+    rows[i] = &pixels[i * row_size];
+  }
+  png_read_image(png_ptr, &rows[0]);
+  png_read_end(png_ptr, 0);
+
+  png_destroy_read_struct(&png_ptr, &info_ptr, 0);
+  return true;
+}
+
+
+/**
+ * Writes random pixels with one filter type and decodes them again.
+ *
+ * @return  true if the decoded pixels match
+ */
+bool RoundTrip(int color_type, int bit_depth, int width, int filter,
+               unsigned& seed)
+{
+  static const int channels[] = { 1, 0, 3, 0, 2, 0, 4 };
+  const int row_size = width * channels[color_type] * bit_depth / 8;
+  const int height = 4;
+
+  std::vector<byte> pixels(row_size * height);
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    seed = seed * 1103515245 + 12345;
+    pixels[i] = byte(seed >> 16);
+  }
+
+  Buffer buffer;
+  buffer.position = 0;
+
+  png_structp png_ptr = png_create_write_struct(
+    PNG_LIBPNG_VER_STRING, 0, 0, PNG_warning);
+  if (!png_ptr) {
+    return false;
+  }
+  png_infop info_ptr = png_create_info_struct(png_ptr);
+  if (!info_ptr) {
+    png_destroy_write_struct(&png_ptr, 0);
+    return false;
+  }
+  if (setjmp(png_jmpbuf(png_ptr))) {
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    return false;
+  }
+
+  png_set_write_fn(png_ptr, &buffer, PNG_write, PNG_flush);
+  png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, filter);
+  png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, color_type,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+               PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png_ptr, info_ptr);
+  for (int i = 0; i < height; ++i) {
+    png_write_row(png_ptr, &pixels[i * row_size]);
+  }
+  png_write_end(png_ptr, info_ptr);
+  png_destroy_write_struct(&png_ptr, &info_ptr);
+
+  std::vector<byte> decoded;
+  return Decode(PNG_read, &buffer, 0, decoded) && decoded == pixels;
+}
+
+
+int main(int argc, char** argv) {
+  static const int formats[][2] = {
+    { PNG_COLOR_TYPE_GRAY,       8  },
+    { PNG_COLOR_TYPE_GRAY,       16 },
+    { PNG_COLOR_TYPE_RGB,        8  },
+    { PNG_COLOR_TYPE_GRAY_ALPHA, 16 },
+    { PNG_COLOR_TYPE_RGB_ALPHA,  8  },
+    { PNG_COLOR_TYPE_RGB,        16 },
+    { PNG_COLOR_TYPE_RGB_ALPHA,  16 },
+  };
+  static const int widths[] = { 1, 2, 3, 4, 5, 7, 15, 16, 17, 33, 100 };
+  static const int filters[] = {
+    PNG_FILTER_NONE,
+    PNG_FILTER_SUB,
+    PNG_FILTER_UP,
+    PNG_FILTER_AVG,
+    PNG_FILTER_PAETH,
+  };
+
+  int failures = 0;
+  unsigned seed = 1;
+  for (size_t f = 0; f < sizeof(formats) / sizeof(*formats); ++f) {
+    for (size_t w = 0; w < sizeof(widths) / sizeof(*widths); ++w) {
+      for (size_t i = 0; i < sizeof(filters) / sizeof(*filters); ++i) {
+        if (!RoundTrip(formats[f][0], formats[f][1], widths[w],
+                       filters[i], seed)) {
+          printf("FAILED: color type %d, bit depth %d, width %d, "
+                 "filter %d\n",
+                 formats[f][0], formats[f][1], widths[w], filters[i]);
+          ++failures;
+        }
+      }
+    }
+  }
+
+  for (int i = 1; i < argc; ++i) {
+    FILE* file = fopen(argv[i], "rb");
+    if (!file) {
+      printf("%s: can't open\n", argv[i]);
+      ++failures;
+      continue;
+    }
+
+    std::vector<byte> pixels;
+    if (Decode(0, 0, file, pixels)) {
+      uLong crc = crc32(0L, Z_NULL, 0);
+      if (!pixels.empty()) {
+        crc = crc32(crc, &pixels[0], uInt(pixels.size()));
+      }
+      printf("%s: %08lx\n", argv[i], crc);
+    } else {
+      // the pngsuite has broken files on purpose
+      printf("%s: error\n", argv[i]);
+    }
+    fclose(file);
+  }
+
+  return (failures ? 1 : 0);
+}
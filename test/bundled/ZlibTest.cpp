@@ -0,0 +1,373 @@
+/**
+ * Checks the bundled zlib: crc32 and adler32 against known values and
+ * bytewise references, and deflate streams inflated back, whole and
+ * in pieces.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "zlib.h"
+
+
+typedef unsigned char byte;
+
+
+static int g_failures = 0;
+
+#define CHECK(condition)                                        \
+  if (!(condition)) {                                           \
+    printf("FAILED: %s, line %d: %s\n",                         \
+           __FILE__, __LINE__, #condition);                     \
+    ++g_failures;                                               \
+  }
+
+
+std::vector<byte> RandomBytes(int size) {
+  std::vector<byte> bytes(size);
+  unsigned seed = 1;
+  for (int i = 0; i < size; ++i) {
+    seed = seed * 1103515245 + 12345;
+    bytes[i] = byte(seed >> 16);
+  }
+  return bytes;
+}
+
+
+/**
+ * Bytes made of literals and copies from 1 to 40000 bytes back, so
+ * inflate sees short overlapping matches and matches across the
+ * window.
+ */
+std::vector<byte> RepetitiveBytes(int size) {
+  std::vector<byte> bytes;
+  unsigned seed = 2;
+  while (int(bytes.size()) < size) {
+    seed = seed * 1103515245 + 12345;
+    const int r = (seed >> 16) & 0x7FFF;
+    if (bytes.empty() || r % 4 == 0) {
+      bytes.push_back(byte(r));
+    } else {
+      static const int distances[] = { 1, 2, 3, 5, 7, 8, 9, 16, 40000 };
+      int distance = distances[r % 9];
+      if (distance > int(bytes.size())) {
+        distance = int(bytes.size());
+      }
+      const int length = 3 + r % 256;
+      for (int i = 0; i < length; ++i) {
+        bytes.push_back(bytes[bytes.size() - distance]);
+      }
+    }
+  }
+  bytes.resize(size);
+  return bytes;
+}
+
+
+uLong ReferenceCRC32(const byte* data, int size) {
+  uLong crc = 0xFFFFFFFFL;
+  for (int i = 0; i < size; ++i) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; ++k) {
+      crc = (crc & 1 ? (crc >> 1) ^ 0xEDB88320L : crc >> 1);
+    }
+  }
+  return crc ^ 0xFFFFFFFFL;
+}
+
+
+uLong ReferenceAdler32(const byte* data, int size) {
+  uLong a = 1;
+  uLong b = 0;
+  for (int i = 0; i < size; ++i) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return (b << 16) | a;
+}
+
+
+void TestChecksums() {
+  const byte* digits = (const byte*)"123456789";
+  CHECK(crc32(0, digits, 9) == 0xCBF43926L);
+  CHECK(adler32(1, digits, 9) == 0x091E01DEL);
+  CHECK(crc32(0, Z_NULL, 0) == 0);
+  CHECK(adler32(0, Z_NULL, 0) == 1);
+
+  const std::vector<byte> random = RandomBytes(100000);
+  CHECK(crc32(0, &random[0], 100000) == 0xDD0D690DL);
+  CHECK(adler32(1, &random[0], 100000) == 0xA0E54A09L);
+
+  // the sums are reduced every 5552 bytes
+  const std::vector<byte> ones(5552 * 3 + 7, 0xFF);
+  CHECK(crc32(0, &ones[0], uInt(ones.size())) == 0xB44DA334L);
+  CHECK(adler32(1, &ones[0], uInt(ones.size())) == 0x08B5D9AAL);
+
+  // every alignment, and lengths around the block sizes
+  for (int offset = 0; offset < 16; ++offset) {
+    for (int size = 0; size <= 300; ++size) {
+      const byte* data = &random[offset];
+      CHECK(crc32(0, data, size) == ReferenceCRC32(data, size));
+      CHECK(adler32(1, data, size) == ReferenceAdler32(data, size));
+    }
+  }
+
+  // in pieces
+  uLong crc = crc32(0, Z_NULL, 0);
+  uLong adler = adler32(0, Z_NULL, 0);
+  for (int i = 0, step = 1; i < 100000; i += step, step = step * 3 % 997) {
+    const int size = (i + step < 100000 ? step : 100000 - i);
+    crc = crc32(crc, &random[i], size);
+    adler = adler32(adler, &random[i], size);
+  }
+  CHECK(crc == 0xDD0D690DL);
+  CHECK(adler == 0xA0E54A09L);
+}
+
+
+/**
+ * Inflates a stream, feeding it in_chunk bytes and taking out_chunk
+ * bytes at a time.
+ *
+ * @return  true if it inflates to expected
+ */
+bool Inflate(const std::vector<byte>& compressed,
+             const std::vector<byte>& expected,
+             int in_chunk, int out_chunk)
+{
+  std::vector<byte> out(expected.size() + 1);
+
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit(&stream) != Z_OK) {
+    return false;
+  }
+
+  const byte* in_end = &compressed[0] + compressed.size();
+  stream.next_in  = (Bytef*)&compressed[0];
+  stream.next_out = &out[0];
+  int result = Z_OK;
+  while (result == Z_OK) {
+    const int in_left  = int(in_end - stream.next_in);
+    const int out_left = int(&out[0] + out.size() - stream.next_out);
+    stream.avail_in  = (in_left  < in_chunk  ? in_left  : in_chunk);
+    stream.avail_out = (out_left < out_chunk ? out_left : out_chunk);
+    result = inflate(&stream, Z_NO_FLUSH);
+    if (result == Z_BUF_ERROR && in_left > 0 && out_left > 0) {
+      result = Z_OK;
+    }
+  }
+  inflateEnd(&stream);
+
+  return (result == Z_STREAM_END &&
+          stream.total_out == expected.size() &&
+          (expected.empty() ||
+           memcmp(&out[0], &expected[0], expected.size()) == 0));
+}
+
+
+void TestKnownStream() {
+  static const byte stream[] = {
+    0x78, 0xda, 0x73, 0xce, 0x2f, 0xca, 0xcf, 0x4b, 0x54, 0xc8, 0x2c,
+    0x56, 0x48, 0xcc, 0x53, 0xc8, 0xcc, 0x4d, 0x4c, 0x4f, 0x55, 0xc8,
+    0xcc, 0x2b, 0x28, 0x2d, 0xd1, 0xcf, 0x2f, 0x2d, 0x01, 0x52, 0x0a,
+    0x39, 0x99, 0x49, 0x45, 0x89, 0x45, 0x95, 0x7a, 0x0a, 0xce, 0x43,
+    0x40, 0xa1, 0x67, 0x89, 0x42, 0x51, 0x6a, 0x62, 0x4a, 0xb1, 0x42,
+    0x80, 0x9f, 0xbb, 0x8e, 0x82, 0x57, 0x80, 0x2b, 0x90, 0x0c, 0x70,
+    0x8e, 0xd0, 0x51, 0x70, 0xf2, 0x0d, 0xd0, 0x51, 0x08, 0x71, 0x77,
+    0xd4, 0x01, 0x9a, 0x90, 0xa2, 0xe0, 0xee, 0xe9, 0x06, 0x31, 0xa6,
+    0x58, 0x0f, 0x00, 0x41, 0xb4, 0x59, 0x36,
+  };
+
+  std::string text;
+  for (int i = 0; i < 5; ++i) {
+    text += "Corona is an image input/output library. ";
+  }
+  text += "It reads PNG, JPEG, PCX, BMP, TGA, and GIF images.";
+
+  const std::vector<byte> compressed(stream, stream + sizeof(stream));
+  const std::vector<byte> expected(text.begin(), text.end());
+  CHECK(Inflate(compressed, expected, sizeof(stream), 1024));
+  CHECK(Inflate(compressed, expected, 1, 1));
+}
+
+
+std::vector<byte> Deflate(const std::vector<byte>& data, int level,
+                          int strategy)
+{
+  std::vector<byte> out(data.size() + data.size() / 1000 + 64);
+
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, level, Z_DEFLATED, 15, 8, strategy) != Z_OK) {
+    return std::vector<byte>();
+  }
+  stream.next_in   = (Bytef*)&data[0];
+  stream.avail_in  = uInt(data.size());
+  stream.next_out  = &out[0];
+  stream.avail_out = uInt(out.size());
+  const int result = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+
+  return (result == Z_STREAM_END ? out : std::vector<byte>());
+}
+
+
+void TestRoundTrips() {
+  static const int strategies[] = {
+    Z_DEFAULT_STRATEGY,
+    Z_FILTERED,
+    Z_HUFFMAN_ONLY,
+  };
+  static const int chunks[][2] = {
+    { 1 << 30, 1 << 30 },
+    { 1,       1       },
+    { 13,      4096    },
+    { 4096,    300     },
+  };
+
+  std::vector<byte> inputs[2];
+  inputs[0] = RandomBytes(100000);
+  inputs[1] = RepetitiveBytes(200000);
+
+  for (int n = 0; n < 2; ++n) {
+    for (int level = 0; level <= 9; ++level) {
+      for (int s = 0; s < 3; ++s) {
+        const std::vector<byte> compressed =
+          Deflate(inputs[n], level, strategies[s]);
+        CHECK(!compressed.empty());
+        if (compressed.empty()) {
+          continue;
+        }
+        for (int c = 0; c < 4; ++c) {
+          if (!Inflate(compressed, inputs[n], chunks[c][0], chunks[c][1])) {
+            printf("FAILED: input %d, level %d, strategy %d, chunks "
+                   "%d/%d\n", n, level, strategies[s],
+                   chunks[c][0], chunks[c][1]);
+            ++g_failures;
+          }
+        }
+      }
+    }
+  }
+}
+
+
+/**
+ * Writes a zlib stream in one fixed Huffman block, for streams zlib's
+ * own deflate never makes.
+ */
+class FixedBlockWriter {
+public:
+  FixedBlockWriter() {
+    m_bits = 0;
+    m_bit_count = 0;
+    m_stream.push_back(0x78);  // deflate, 32K window
+    m_stream.push_back(0x01);
+    write(1, 1);               // last block
+    write(1, 2);               // fixed Huffman codes
+  }
+
+  void literal(byte value) {
+    if (value < 144) {
+      code(0x30 + value, 8);
+    } else {
+      code(0x190 + value - 144, 9);
+    }
+    m_data.push_back(value);
+  }
+
+  /// length must be from 3 to 10, distance from 1 to 4 or over 24576
+  void match(int length, int distance) {
+    code(length - 3 + 1, 7);  // length codes 257 to 264
+    if (distance <= 4) {
+      code(distance - 1, 5);
+    } else {
+      code(29, 5);
+      write(distance - 24577, 13);
+    }
+    for (int i = 0; i < length; ++i) {
+      m_data.push_back(m_data[m_data.size() - distance]);
+    }
+  }
+
+  std::vector<byte> finish() {
+    code(0, 7);  // end of block
+    if (m_bit_count) {
+      write(0, 8 - m_bit_count);
+    }
+    const uLong adler = ReferenceAdler32(&m_data[0], int(m_data.size()));
+    for (int i = 3; i >= 0; --i) {
+      m_stream.push_back(byte(adler >> (i * 8)));
+    }
+    return m_stream;
+  }
+
+  const std::vector<byte>& data() const {
+    return m_data;
+  }
+
+private:
+  // Huffman codes go most significant bit first
+  void code(int value, int length) {
+    for (int i = length - 1; i >= 0; --i) {
+      write((value >> i) & 1, 1);
+    }
+  }
+
+  void write(int value, int length) {
+    for (int i = 0; i < length; ++i) {
+      m_bits |= ((value >> i) & 1) << m_bit_count;
+      if (++m_bit_count == 8) {
+        m_stream.push_back(byte(m_bits));
+        m_bits = 0;
+        m_bit_count = 0;
+      }
+    }
+  }
+
+  std::vector<byte> m_stream;
+  std::vector<byte> m_data;
+  int m_bits;
+  int m_bit_count;
+};
+
+
+void TestFarDistances() {
+  // once the window has wrapped, the bytes just past a match are the
+  // oldest history, which a match 32768 - k bytes back reads
+  const std::vector<byte> random = RandomBytes(40000);
+  FixedBlockWriter writer;
+  for (int i = 0; i < 40000; ++i) {
+    writer.literal(random[i]);
+  }
+  for (int k = 0; k < 8; ++k) {
+    for (int length = 3; length <= 10; ++length) {
+      writer.match(length, 1 + k % 4);
+      writer.match(3, 32768 - k);
+    }
+  }
+
+  const std::vector<byte> compressed = writer.finish();
+  CHECK(Inflate(compressed, writer.data(), 1 << 30, 1 << 30));
+  CHECK(Inflate(compressed, writer.data(), 4096, 300));
+  CHECK(Inflate(compressed, writer.data(), 1, 1));
+}
+
+
+int main() {
+  TestChecksums();
+  TestKnownStream();
+  TestFarDistances();
+  TestRoundTrips();
+
+  if (g_failures) {
+    printf("%d failures\n", g_failures);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <memory>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <corona.h>
+using namespace std;
+using namespace corona;
+
+
+// Times decoding of the images named on the command line.  Each file is
+// read into memory once and then decoded repeatedly from there, so disk
+// speed doesn't enter into it.
+
+
+bool readFile(const char* filename, vector<char>& contents) {
+    auto_ptr<File> file(OpenFile(filename, false));
+    if (!file.get() || !file->seek(0, File::END)) {
+        return false;
+    }
+    const int size = file->tell();
+    file->seek(0, File::BEGIN);
+
+    contents.resize(size + 1);  // never empty, so &contents[0] is valid
+    return file->read(&contents[0], size) == size;
+}
+
+
+int main(int argc, char* argv[]) {
+    int iterations = 20;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        iterations = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || iterations <= 0) {
+        puts("Usage: corbench [-n <iterations>] <file>...");
+        return EXIT_FAILURE;
+    }
+
+    double total_seconds = 0;
+    double total_pixels  = 0;
+    int failures = 0;
+
+    for (int i = first; i < argc; ++i) {
+        const char* filename = argv[i];
+
+        vector<char> contents;
+        if (!readFile(filename, contents)) {
+            printf("%-40s could not be read\n", filename);
+            ++failures;
+            continue;
+        }
+        const int size = int(contents.size()) - 1;
+
+        int width = 0;
+        int height = 0;
+        bool failed = false;
+
+        const clock_t start = clock();
+        for (int j = 0; j < iterations && !failed; ++j) {
+            auto_ptr<File> file(CreateReadOnlyMemoryFile(&contents[0], size));
+            auto_ptr<Image> image(OpenImage(file.get()));
+            if (image.get()) {
+                width  = image->getWidth();
+                height = image->getHeight();
+            } else {
+                failed = true;
+            }
+        }
+        const double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+
+        if (failed) {
+            printf("%-40s could not be decoded\n", filename);
+            ++failures;
+            continue;
+        }
+
+        const double pixels = double(width) * height * iterations;
+        printf("%-40s %5dx%-5d %9.3f ms %8.2f Mpixels/s\n",
+               filename, width, height,
+               seconds * 1000 / iterations,
+               seconds > 0 ? pixels / seconds / 1e6 : 0);
+        total_seconds += seconds;
+        total_pixels  += pixels;
+    }
+
+    printf("total: %.3f s for %d decode(s) of %d file(s)",
+           total_seconds, iterations, argc - first - failures);
+    if (total_seconds > 0) {
+        printf(", %.2f Mpixels/s", total_pixels / total_seconds / 1e6);
+    }
+    printf("\n");
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
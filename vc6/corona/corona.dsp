@@ -43,7 +43,7 @@ RSC=rc.exe
 # PROP Ignore_Export_Lib 0
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /MT /W3 /GX /O2 /D "WIN32" /D "NDEBUG" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "CORONA_EXPORTS" /YX /FD /c
-# ADD CPP /nologo /MD /W3 /GX /O2 /I "../../src/libungif-4.1.0" /I "../../src/jpeg-6b" /I "../../src/libpng-1.5.12" /I "../../src/zlib-1.1.4" /D "NDEBUG" /D for="if (0) ; else for" /D "WIN32" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "CORONA_EXPORTS" /FD /c
+# ADD CPP /nologo /MD /W3 /GX /GR /O2 /I "../../src/libungif-4.1.0" /I "../../src/jpeg-6b" /I "../../src/libpng-1.5.12" /I "../../src/zlib-1.1.4" /D "NDEBUG" /D for="if (0) ; else for" /D "WIN32" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "CORONA_EXPORTS" /FD /c
 # SUBTRACT CPP /YX
 # ADD BASE MTL /nologo /D "NDEBUG" /mktyplib203 /win32
 # ADD MTL /nologo /D "NDEBUG" /mktyplib203 /win32
@@ -70,7 +70,7 @@ LINK32=link.exe
 # PROP Ignore_Export_Lib 0
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /MTd /W3 /Gm /GX /ZI /Od /D "WIN32" /D "_DEBUG" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "CORONA_EXPORTS" /YX /FD /GZ /c
-# ADD CPP /nologo /MDd /W3 /Gm /GX /ZI /Od /I "../../src/libungif-4.1.0" /I "../../src/jpeg-6b" /I "../../src/libpng-1.5.12" /I "../../src/zlib-1.1.4" /D "_DEBUG" /D for="if (0) ; else for" /D "WIN32" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "CORONA_EXPORTS" /FD /GZ /c
+# ADD CPP /nologo /MDd /W3 /Gm /GX /GR /ZI /Od /I "../../src/libungif-4.1.0" /I "../../src/jpeg-6b" /I "../../src/libpng-1.5.12" /I "../../src/zlib-1.1.4" /D "_DEBUG" /D for="if (0) ; else for" /D "WIN32" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "CORONA_EXPORTS" /FD /GZ /c
 # SUBTRACT CPP /YX
 # ADD BASE MTL /nologo /D "_DEBUG" /mktyplib203 /win32
 # ADD MTL /nologo /D "_DEBUG" /mktyplib203 /win32
@@ -94,10 +94,34 @@ LINK32=link.exe
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\..\src\Allocator.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\Allocator.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\BufferedFile.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\BufferedFile.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\Convert.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\src\Convert.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\ConvertSIMD.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\Corona.cpp
 # End Source File
 # Begin Source File
@@ -174,6 +198,14 @@ SOURCE=..\..\src\SimpleImage.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\src\Thread.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\Thread.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\Types.h
 # End Source File
 # Begin Source File
@@ -289,6 +321,10 @@ SOURCE="..\..\src\zlib-1.1.4\zutil.h"
 
 # PROP Default_Filter ""
 # Begin Source File
+SOURCE="..\..\src\libpng-1.5.12\filter_sse2_intrinsics.c"
+# End Source File
+# Begin Source File
+
 SOURCE="..\..\src\libpng-1.5.12\png.c"
 # End Source File
 # Begin Source File
@@ -105,6 +105,14 @@ SOURCE=..\..\test\BMPTests.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\test\ConvertTests.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\test\ConvertTests.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\test\CoronaTest.cpp
 # End Source File
 # Begin Source File
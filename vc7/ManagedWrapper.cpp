@@ -6,7 +6,7 @@
 using namespace System;
 using namespace System::Text;
 
-[assembly: System::Reflection::AssemblyVersion("1.0.2.0")];
+[assembly: System::Reflection::AssemblyVersion("1.1.0.0")];
 [assembly: System::Reflection::AssemblyKeyFileAttribute("Corona.snk")];
 
 
@@ -34,6 +34,11 @@ namespace Corona {
     I8        = 0x0203,
     B8G8R8A8  = 0x0204,
     B8G8R8    = 0x0205,
+    L8        = 0x0206,
+    L8A8      = 0x0207,
+    YCbCr444  = 0x0208,
+    YCbCr422  = 0x0209,
+    YCbCr420  = 0x020A,
   };
 
 